@@ -0,0 +1,301 @@
+/**
+ * @brief Micro-benchmarks for the Flyweight word storage.
+ * Compares the flat `StringInterner` against the `boost::bimap` that used to back the Word class, on `test.txt` scaled up 1000x.
+ * Also compares the string_view Sentence tokenizer against the old istringstream one, scaling with threads is measured by ScalingBenchmark.cpp.
+ * It reports how much a compaction pass shrinks a Book, and times word and bigram counting on keys against string-keyed maps.
+ * Finally it compares rebuilding the text of a Book against the old copying get_text, and building a Book from text against loading a saved one.
+ */
+
+#include "Book.h"
+#include "CountingAllocator.h"
+#include "StringInterner.h"
+#include "boost/bimap.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Splits the text into words the same way Sentence does i.e. on spaces with trailing punctuation as a word of its own.
+ */
+std::vector<std::string> tokenize(const std::string &file, int repeat)
+{
+    std::vector<std::string> tokens;
+    std::ifstream ifs(file);
+    std::string token;
+    std::vector<std::string> once;
+    while (ifs >> token)
+    {
+        std::string lim;
+        if (token.back() == '.' || token.back() == ',')
+        {
+            lim += token.back();
+            token.pop_back();
+        }
+        once.push_back(token);
+        once.push_back(lim);
+    }
+    tokens.reserve(once.size() * repeat);
+    for (int i = 0; i < repeat; i++)
+        tokens.insert(tokens.end(), once.begin(), once.end());
+    return tokens;
+}
+
+// Reads the lines of the text, repeated the given number of times.
+std::vector<std::string> read_sentences(const std::string &file, int repeat)
+{
+    std::vector<std::string> once;
+    std::ifstream ifs(file);
+    std::string sentence;
+    while (std::getline(ifs, sentence))
+        once.push_back(sentence);
+
+    std::vector<std::string> sentences;
+    sentences.reserve(once.size() * repeat);
+    for (int i = 0; i < repeat; i++)
+        sentences.insert(sentences.end(), once.begin(), once.end());
+    return sentences;
+}
+
+/**
+ * @brief Tokenizer that Sentence used before it switched to string_view slices, kept as the baseline.
+ */
+std::vector<key> legacy_sentence(std::string sentence)
+{
+    std::vector<key> sentence_words;
+    std::istringstream iss(sentence);
+    std::string token;
+
+    while (std::getline(iss, token, ' '))
+    {
+        std::string lim;
+        if (token.back() == '.' || token.back() == ',')
+        {
+            lim += token.back();
+            token.pop_back();
+        }
+        sentence_words.push_back(Word::add_word(token));
+        sentence_words.push_back(Word::add_word(lim));
+    }
+    return sentence_words;
+}
+
+/**
+ * @brief Text reconstruction that Book used before it wrote into a pre-sized buffer, kept as the baseline.
+ */
+std::string legacy_text(std::vector<Sentence> text)
+{
+    std::string res;
+    for (auto a : text)
+    {
+        std::string sentence = "";
+        for (auto word_key : a.keys())
+        {
+            std::string word = Word::get_word(word_key);
+            sentence += (word == "." || word == "," ? "" : " ");
+            sentence += word;
+        }
+        if (sentence.size())
+            sentence.erase(sentence.begin());
+        res += sentence;
+    }
+    return res;
+}
+
+// Runs the function and returns the time it took in nanoseconds per token.
+template <typename F>
+double time_per_token(size_t tokens, F &&f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / tokens;
+}
+
+void report(const char *name, double insert_ns, double lookup_ns, size_t memory)
+{
+    std::cout << name << " :: insert " << insert_ns << " ns/token, lookup " << lookup_ns << " ns/token, memory "
+              << memory << " bytes.\n";
+}
+
+int main()
+{
+    auto tokens = tokenize("test.txt", 1000);
+    std::vector<uint32_t> keys(tokens.size());
+    size_t checksum = 0;
+    std::cout << "Tokens :: " << tokens.size() << "\n";
+
+    {
+        size_t before = live_bytes;
+        boost::bimap<uint32_t, std::string> words;
+        uint32_t seed = 0;
+        double insert_ns = time_per_token(tokens.size(), [&]
+                                          {
+            for (size_t i = 0; i < tokens.size(); i++)
+            {
+                auto word_key = words.right.find(tokens[i]);
+                if (word_key != words.right.end())
+                {
+                    keys[i] = word_key->second;
+                    continue;
+                }
+                words.insert({++seed, tokens[i]});
+                keys[i] = seed;
+            } });
+        double lookup_ns = time_per_token(tokens.size(), [&]
+                                          {
+            for (auto word_key : keys)
+                checksum += words.left.find(word_key)->second.size(); });
+        report("boost::bimap   ", insert_ns, lookup_ns, live_bytes - before);
+    }
+
+    {
+        size_t before = live_bytes;
+        StringInterner words;
+        double insert_ns = time_per_token(tokens.size(), [&]
+                                          {
+            for (size_t i = 0; i < tokens.size(); i++)
+                keys[i] = words.intern(tokens[i]); });
+        double lookup_ns = time_per_token(tokens.size(), [&]
+                                          {
+            for (auto word_key : keys)
+                checksum += words.get(word_key).size(); });
+        report("StringInterner ", insert_ns, lookup_ns, live_bytes - before);
+    }
+
+    {
+        size_t before = live_bytes;
+        ShardedStringInterner words;
+        double insert_ns = time_per_token(tokens.size(), [&]
+                                          {
+            for (size_t i = 0; i < tokens.size(); i++)
+                keys[i] = words.intern(tokens[i]); });
+        double lookup_ns = time_per_token(tokens.size(), [&]
+                                          {
+            for (auto word_key : keys)
+                checksum += words.get(word_key).size(); });
+        report("Sharded        ", insert_ns, lookup_ns, live_bytes - before);
+    }
+
+    // Tokenizes every sentence with both tokenizers, counting the allocations made per sentence.
+    auto sentences = read_sentences("test.txt", 2000);
+    {
+        size_t before = allocation_count;
+        double legacy_ns = time_per_token(sentences.size(), [&]
+                                          {
+            for (auto &sentence : sentences)
+                checksum += legacy_sentence(sentence).size(); });
+        double legacy_allocs = double(allocation_count - before) / sentences.size();
+
+        before = allocation_count;
+        double view_ns = time_per_token(sentences.size(), [&]
+                                        {
+            for (auto &sentence : sentences)
+                checksum += Sentence(sentence).size(); });
+        double view_allocs = double(allocation_count - before) / sentences.size();
+
+        std::cout << "istringstream tokenizer :: " << legacy_ns << " ns/sentence, " << legacy_allocs << " allocations/sentence.\n";
+        std::cout << "string_view tokenizer   :: " << view_ns << " ns/sentence, " << view_allocs << " allocations/sentence.\n";
+    }
+
+    // Rebuilds the text of the whole corpus with both reconstructions.
+    {
+        Book book;
+        std::vector<Sentence> text;
+        for (auto &sentence : sentences)
+        {
+            book.add_Sentence(sentence);
+            text.push_back(Sentence(sentence));
+        }
+
+        size_t before = allocation_count;
+        double legacy_ns = time_per_token(sentences.size(), [&]
+                                          { checksum += legacy_text(text).size(); });
+        double legacy_allocs = double(allocation_count - before) / sentences.size();
+
+        before = allocation_count;
+        double sized_ns = time_per_token(sentences.size(), [&]
+                                         { checksum += book.get_text().size(); });
+        double sized_allocs = double(allocation_count - before) / sentences.size();
+
+        std::cout << "Copying get_text   :: " << legacy_ns << " ns/sentence, " << legacy_allocs << " allocations/sentence.\n";
+        std::cout << "Pre-sized get_text :: " << sized_ns << " ns/sentence, " << sized_allocs << " allocations/sentence.\n";
+    }
+
+    // Compacts a Book of the whole corpus and rebuilds its text from the compacted form.
+    {
+        Book book;
+        book.add_Sentences(sentences, 1);
+        BookMemory plain = book.memory();
+        double compact_ns = time_per_token(sentences.size(), [&]
+                                           { book.compact(); });
+        BookMemory compacted = book.memory();
+        double text_ns = time_per_token(sentences.size(), [&]
+                                        { checksum += book.get_text().size(); });
+
+        std::cout << "Plain Book     :: " << plain << ".\n";
+        std::cout << "Compacted Book :: " << compacted << ", compaction " << compact_ns << " ns/sentence, get_text "
+                  << text_ns << " ns/sentence.\n";
+    }
+
+    // Counts words and bigrams of the whole corpus on strings, then on keys with 1..N threads.
+    {
+        unsigned max_threads = std::max(16u, std::thread::hardware_concurrency());
+        Book book;
+        book.add_Sentences(sentences, 1);
+
+        auto corpus_tokens = tokenize("test.txt", 2000);
+        double string_ns = time_per_token(sentences.size(), [&]
+                                          {
+            std::unordered_map<std::string, uint64_t> frequencies;
+            std::unordered_map<std::string, uint64_t> bigrams;
+            std::string previous;
+            for (auto &token : corpus_tokens)
+            {
+                if (token.empty())
+                    continue;
+                frequencies[token]++;
+                bigrams[previous + " " + token]++;
+                previous = token;
+            }
+            checksum += frequencies.size() + bigrams.size(); });
+        std::cout << "String-keyed statistics :: " << string_ns << " ns/sentence.\n";
+
+        for (unsigned threads = 1; threads <= max_threads; threads *= 2)
+        {
+            double key_ns = time_per_token(sentences.size(), [&]
+                                           { checksum += book.statistics(threads).bigrams.size(); });
+            std::cout << "Key statistics with " << threads << " thread(s) :: " << key_ns << " ns/sentence.\n";
+        }
+    }
+
+    // Saves a Book of the whole corpus and loads it back into an empty Word store.
+    {
+        Book book;
+        double build_ns = time_per_token(sentences.size(), [&]
+                                         { book.add_Sentences(sentences, 1); });
+        book.save("test.bin");
+        size_t file_size = std::filesystem::file_size("test.bin");
+
+        // ! Leaves `book` with dangling keys, it is not used after this point.
+        Word::clear();
+        Book loaded;
+        double load_ns = time_per_token(sentences.size(), [&]
+                                        { loaded.load("test.bin"); });
+        std::remove("test.bin");
+
+        std::cout << "Book from text :: " << build_ns << " ns/sentence.\n";
+        std::cout << "Book from file :: " << load_ns << " ns/sentence, " << file_size << " bytes on disk.\n";
+    }
+
+    // Printed so that the lookups cannot be optimized away.
+    std::cout << "Checksum :: " << checksum << "\n";
+    return 0;
+}
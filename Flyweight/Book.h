@@ -0,0 +1,581 @@
+#pragma once
+#include "CompactText.h"
+#include "Encoding.h"
+#include "Statistics.h"
+#include "StringInterner.h"
+#include "boost/interprocess/file_mapping.hpp"
+#include "boost/interprocess/mapped_region.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+typedef uint32_t key;
+
+/**
+ * @brief Monostate Word class that keeps track of all the unique words in a static `ShardedStringInterner`.
+ * Words can be added and read from multiple threads at once.
+ */
+class Word
+{
+    // Stores all the unique words along with their keys.
+    inline static ShardedStringInterner words;
+
+public:
+    /**
+     * @brief Get the word stored int the map at the given key.
+     */
+    static std::string get_word(key word_key)
+    {
+        return std::string(words.get(word_key));
+    }
+
+    /**
+     * @brief Get a view of the word stored at the given key, valid for as long as the word is in the map.
+     */
+    static std::string_view view_word(key word_key)
+    {
+        return words.get(word_key);
+    }
+
+    /**
+     * @brief Stores the word in the map and returns the key.
+     */
+    static key add_word(std::string_view word)
+    {
+        return words.intern(word);
+    }
+
+    /**
+     * @brief Get the current memory size by the map.
+     */
+    static size_t get_map_memory()
+    {
+        return words.memory().total();
+    }
+
+    /**
+     * @brief Get the memory held by the map, split by what it is used for.
+     */
+    static InternerMemory memory()
+    {
+        return words.memory();
+    }
+
+    /**
+     * @brief Writes the dictionary of all the words seen so far.
+     */
+    static void save(std::ostream &os)
+    {
+        words.save(os);
+    }
+
+    /**
+     * @brief Loads a dictionary written by `save`, `storage` keeps the buffer behind the reader alive.
+     * `loaded` is set to the size of every saved shard, a saved key is only valid if `ShardedStringInterner::within` them.
+     * If no words have been added yet, the dictionary is adopted as is and an empty vector is returned.
+     * Otherwise every saved word is added again and the returned vector maps each valid saved key to its new key.
+     */
+    static std::vector<key> load(ByteReader &reader, std::shared_ptr<const void> storage, ShardedStringInterner::ShardSizes &loaded)
+    {
+        if (words.size() == 0)
+        {
+            loaded = words.load(reader, std::move(storage));
+            return {};
+        }
+
+        ShardedStringInterner saved;
+        loaded = saved.load(reader, std::move(storage));
+        std::vector<key> remap;
+        saved.for_each([&](key saved_key, std::string_view word)
+                       {
+            if (saved_key >= remap.size())
+                remap.resize(saved_key + 1, ShardedStringInterner::npos);
+            remap[saved_key] = words.intern(word); });
+        return remap;
+    }
+
+    /**
+     * @brief Forgets all the words.
+     * !@warning Every Sentence created so far is left with dangling keys.
+     */
+    static void clear()
+    {
+        words.clear();
+    }
+};
+
+/**
+ * @brief Sentence stores each word as a key in the words map.
+ */
+class Sentence
+{
+    std::vector<key> sentence_words;
+
+public:
+    // Construct a new Sentence object from the keys of its words.
+    explicit Sentence(std::vector<key> sentence_words) : sentence_words(std::move(sentence_words)) {}
+
+    /**
+     * @brief Construct a new Sentence object from the given string sentence.
+     * Scans the sentence once and interns views of it, trailing '.' or ',' is stored as a word of its own.
+     */
+    Sentence(std::string_view sentence)
+    {
+        // Keys are collected in a per-thread scratch buffer so that the sentence itself is allocated once, at its exact size.
+        thread_local std::vector<key> scratch;
+        scratch.clear();
+
+        size_t begin = 0;
+        while (begin < sentence.size())
+        {
+            size_t end = sentence.find(' ', begin);
+            if (end == std::string_view::npos)
+                end = sentence.size();
+
+            std::string_view token = sentence.substr(begin, end - begin);
+            begin = end + 1;
+            if (token.empty())
+                continue;
+
+            if (token.back() == '.' || token.back() == ',')
+            {
+                if (token.size() > 1)
+                    scratch.push_back(Word::add_word(token.substr(0, token.size() - 1)));
+                scratch.push_back(Word::add_word(token.substr(token.size() - 1)));
+            }
+            else
+            {
+                scratch.push_back(Word::add_word(token));
+            }
+        }
+        sentence_words.assign(scratch.begin(), scratch.end());
+    }
+
+    // Number of words in the sentence, punctuation included.
+    size_t size() const
+    {
+        return sentence_words.size();
+    }
+
+    // Bytes held by the keys of the sentence, counting reserved capacity.
+    size_t memory() const
+    {
+        return sentence_words.capacity() * sizeof(key);
+    }
+
+    // Keys of the words in the sentence.
+    const std::vector<key> &keys() const
+    {
+        return sentence_words;
+    }
+
+    /**
+     * @brief Size of the sentence string, so that a buffer for it can be allocated up front.
+     */
+    size_t text_size() const
+    {
+        return text_size(sentence_words);
+    }
+
+    /**
+     * @brief Writes the sentence string into a buffer of at least `text_size()` bytes and returns the end of what was written.
+     */
+    char *write(char *out) const
+    {
+        return write(sentence_words, out);
+    }
+
+    /**
+     * @brief Writes the sentence string to the stream, word by word.
+     */
+    void write(std::ostream &os) const
+    {
+        write(sentence_words, os);
+    }
+
+    // Same as above for the keys of a sentence stored elsewhere e.g. decoded from a compacted Book.
+    static size_t text_size(const std::vector<key> &keys)
+    {
+        size_t res = 0;
+        for (auto word_key : keys)
+        {
+            std::string_view word = Word::view_word(word_key);
+            res += word.size() + (is_punctuation(word) ? 0 : 1);
+        }
+        // The first word is not preceded by a space.
+        return res && !is_punctuation(Word::view_word(keys.front())) ? res - 1 : res;
+    }
+
+    static char *write(const std::vector<key> &keys, char *out)
+    {
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            std::string_view word = Word::view_word(keys[i]);
+            if (i && !is_punctuation(word))
+                *out++ = ' ';
+            out = std::copy(word.begin(), word.end(), out);
+        }
+        return out;
+    }
+
+    static void write(const std::vector<key> &keys, std::ostream &os)
+    {
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            std::string_view word = Word::view_word(keys[i]);
+            if (i && !is_punctuation(word))
+                os.put(' ');
+            os.write(word.data(), word.size());
+        }
+    }
+
+    /**
+     * @brief Resolves keys of the sentence to contruct the sentence string.
+     */
+    std::string get_sentence() const
+    {
+        std::string res(text_size(), ' ');
+        write(res.data());
+        return res;
+    }
+
+private:
+    // Punctuation is written right after the previous word, without a space.
+    static bool is_punctuation(std::string_view word)
+    {
+        return word == "." || word == ",";
+    }
+};
+
+/**
+ * @brief Bytes held by a Book on top of the words in the Word map.
+ */
+struct BookMemory
+{
+    // Array of Sentence objects.
+    size_t sentences{0};
+    // Keys of the words of every sentence.
+    size_t keys{0};
+    // Sentences encoded by the last compaction.
+    size_t compacted{0};
+    // The Book object itself.
+    size_t objects{0};
+
+    size_t total() const
+    {
+        return sentences + keys + compacted + objects;
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const BookMemory &m)
+    {
+        return os << "sentences " << m.sentences << ", keys " << m.keys << ", compacted " << m.compacted << ", objects " << m.objects << " = "
+                  << m.total() << " bytes";
+    }
+};
+
+/**
+ * @brief Collection of Sentences.
+ */
+class Book
+{
+    // Sentences encoded by the last `compact`, they come before the ones in `text`.
+    CompactText compacted;
+    std::vector<Sentence> text;
+    // Guards `compacted` and `text` so that sentences can be added from a thread pool.
+    std::mutex text_mutex;
+
+    // Identifies the files written by `save`.
+    static constexpr char file_magic[8] = {'F', 'L', 'Y', 'W', 'B', 'O', 'O', 'K'};
+    static constexpr uint32_t file_version = 1;
+
+    // Returns the start of the first line at or after the given position.
+    static size_t line_start(std::string_view content, size_t pos)
+    {
+        if (pos == 0 || pos >= content.size())
+            return pos;
+        size_t newline = content.find('\n', pos - 1);
+        return newline == std::string_view::npos ? content.size() : newline + 1;
+    }
+
+    /**
+     * @brief Runs `build_part(part, parts, res)` for every part on its own thread and appends the results in order of the parts.
+     */
+    template <typename F>
+    void build_parallel(unsigned threads, F &&build_part)
+    {
+        threads = std::max(1u, threads);
+        std::vector<std::vector<Sentence>> parts(threads);
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; t++)
+            workers.emplace_back([&, t]
+                                 { build_part(t, threads, parts[t]); });
+        for (auto &worker : workers)
+            worker.join();
+
+        std::lock_guard<std::mutex> lock(text_mutex);
+        for (auto &part : parts)
+            text.insert(text.end(), std::make_move_iterator(part.begin()), std::make_move_iterator(part.end()));
+    }
+
+    /**
+     * @brief Calls `f(keys)` with the keys of every sentence in order, the caller must hold `text_mutex`.
+     */
+    template <typename F>
+    void for_each_keys(F &&f) const
+    {
+        thread_local std::vector<key> scratch;
+        for (size_t i = 0; i < compacted.size(); i++)
+        {
+            compacted.decode(i, scratch);
+            f(static_cast<const std::vector<key> &>(scratch));
+        }
+        for (auto &sentence : text)
+            f(sentence.keys());
+    }
+
+    /**
+     * @brief Returns the keys of the i-th sentence, decoding them into `scratch` if it is compacted. The caller must hold `text_mutex`.
+     */
+    const std::vector<key> &keys_of(size_t i, std::vector<key> &scratch) const
+    {
+        if (i >= compacted.size())
+            return text[i - compacted.size()].keys();
+        compacted.decode(i, scratch);
+        return scratch;
+    }
+
+public:
+    /**
+     * @brief Adds sentence string in to the book.
+     * Safe to call from multiple threads, the sentences are then stored in the order they finish.
+     */
+    void add_Sentence(std::string_view sentence)
+    {
+        Sentence parsed(sentence);
+        std::lock_guard<std::mutex> lock(text_mutex);
+        text.push_back(std::move(parsed));
+    }
+
+    /**
+     * @brief Adds all the sentence strings in to the book in order, tokenizing them on the given number of threads.
+     */
+    void add_Sentences(const std::vector<std::string> &sentences, unsigned threads)
+    {
+        build_parallel(threads, [&](unsigned part, unsigned parts, std::vector<Sentence> &res)
+                       {
+            size_t chunk = (sentences.size() + parts - 1) / parts;
+            size_t begin = std::min(sentences.size(), part * chunk);
+            size_t end = std::min(sentences.size(), begin + chunk);
+            res.reserve(end - begin);
+            for (size_t i = begin; i < end; i++)
+                res.push_back(Sentence(sentences[i])); });
+    }
+
+    /**
+     * @brief Adds every line of the file as a sentence, reading it through a memory mapping rather than copying it.
+     * The file is split in place into one range of whole lines per thread. Returns the size of the file in bytes.
+     */
+    size_t add_file(const std::string &path, unsigned threads = 1)
+    {
+        // An empty file cannot be mapped.
+        if (std::filesystem::file_size(path) == 0)
+            return 0;
+
+        boost::interprocess::file_mapping file(path.c_str(), boost::interprocess::read_only);
+        boost::interprocess::mapped_region region(file, boost::interprocess::read_only);
+        region.advise(boost::interprocess::mapped_region::advice_sequential);
+        std::string_view content(static_cast<const char *>(region.get_address()), region.get_size());
+
+        build_parallel(threads, [&](unsigned part, unsigned parts, std::vector<Sentence> &res)
+                       {
+            size_t begin = line_start(content, content.size() * part / parts);
+            size_t end = line_start(content, content.size() * (part + 1) / parts);
+            while (begin < end)
+            {
+                size_t line_end = std::min(end, content.find('\n', begin));
+                std::string_view sentence = content.substr(begin, line_end - begin);
+                if (!sentence.empty() && sentence.back() == '\r')
+                    sentence.remove_suffix(1);
+                res.push_back(Sentence(sentence));
+                begin = line_end + 1;
+            } });
+        return content.size();
+    }
+
+    /**
+     * @brief Writes the book to a file: the Word dictionary followed by the keys of every sentence as varints.
+     */
+    void save(const std::string &path)
+    {
+        std::ofstream ofs(path, std::ios::binary);
+        ofs.write(file_magic, sizeof(file_magic));
+        put_u32(ofs, file_version);
+
+        // Taken before the dictionary is written, every sentence in the book interned its words before it was added.
+        std::lock_guard<std::mutex> lock(text_mutex);
+        Word::save(ofs);
+        put_u64(ofs, compacted.size() + text.size());
+        for_each_keys([&](const std::vector<key> &keys)
+                      {
+            put_varint(ofs, keys.size());
+            for (auto word_key : keys)
+                put_varint(ofs, word_key); });
+        if (!ofs)
+            throw std::runtime_error("Could not write " + path);
+    }
+
+    /**
+     * @brief Appends the sentences of a book written by `save`.
+     * The file is memory mapped and stays mapped, as the loaded words are used straight from it rather than interned again.
+     */
+    void load(const std::string &path)
+    {
+        boost::interprocess::file_mapping file(path.c_str(), boost::interprocess::read_only);
+        auto region = std::make_shared<boost::interprocess::mapped_region>(file, boost::interprocess::read_only);
+        ByteReader reader(std::string_view(static_cast<const char *>(region->get_address()), region->get_size()));
+
+        if (reader.take(sizeof(file_magic)) != std::string_view(file_magic, sizeof(file_magic)) ||
+            reader.get_u32() != file_version)
+            throw std::runtime_error(path + " is not a saved Book.");
+        ShardedStringInterner::ShardSizes saved_sizes;
+        std::vector<key> remap = Word::load(reader, region, saved_sizes);
+
+        uint64_t count = reader.get_u64();
+        std::vector<Sentence> loaded;
+        loaded.reserve(std::min<uint64_t>(count, reader.remaining()));
+        for (uint64_t i = 0; i < count; i++)
+        {
+            uint64_t size = reader.get_varint();
+            if (size > reader.remaining())
+                throw std::runtime_error("Corrupt sentence length in " + path);
+            std::vector<key> keys(size);
+            for (auto &word_key : keys)
+            {
+                uint64_t saved_key = reader.get_varint();
+                if (saved_key > UINT32_MAX || !ShardedStringInterner::within(static_cast<key>(saved_key), saved_sizes))
+                    throw std::runtime_error("Corrupt key in " + path);
+                word_key = remap.empty() ? static_cast<key>(saved_key) : remap[saved_key];
+            }
+            loaded.push_back(Sentence(std::move(keys)));
+        }
+
+        std::lock_guard<std::mutex> lock(text_mutex);
+        text.insert(text.end(), std::make_move_iterator(loaded.begin()), std::make_move_iterator(loaded.end()));
+    }
+
+    /**
+     * @brief Get the memory held by the book, the words themselves are reported by `Word::memory`.
+     */
+    BookMemory memory()
+    {
+        std::lock_guard<std::mutex> lock(text_mutex);
+        BookMemory res;
+        res.sentences = text.capacity() * sizeof(Sentence);
+        for (auto &sentence : text)
+            res.keys += sentence.memory();
+        res.compacted = compacted.memory();
+        res.objects = sizeof(Book);
+        return res;
+    }
+
+    /**
+     * @brief Counts the words and bigrams of the book on the given number of threads.
+     * Every thread counts its own range of sentences into its own tables, which are merged at the end.
+     */
+    WordStatistics statistics(unsigned threads = 1)
+    {
+        std::lock_guard<std::mutex> lock(text_mutex);
+        threads = std::max(1u, threads);
+        size_t count = compacted.size() + text.size();
+        std::vector<WordStatistics> parts(threads);
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; t++)
+        {
+            workers.emplace_back([&, t]
+                                 {
+                std::vector<key> scratch;
+                for (size_t i = count * t / threads; i < count * (t + 1) / threads; i++)
+                    parts[t].add(keys_of(i, scratch)); });
+        }
+        for (auto &worker : workers)
+            worker.join();
+
+        for (unsigned t = 1; t < threads; t++)
+            parts[0] += parts[t];
+        return std::move(parts[0]);
+    }
+
+    /**
+     * @brief Renumbers the words of the book by frequency and re-encodes all the sentences as variable-length codes.
+     * Sentences added afterwards are stored as usual until the next compaction.
+     */
+    void compact()
+    {
+        std::lock_guard<std::mutex> lock(text_mutex);
+        CompactText res = CompactText::build([&](auto &&f)
+                                             { for_each_keys(f); });
+        compacted = std::move(res);
+        text.clear();
+        text.shrink_to_fit();
+    }
+
+    /**
+     * @brief Size of the book text, so that a buffer for it can be allocated up front.
+     */
+    size_t text_size()
+    {
+        std::lock_guard<std::mutex> lock(text_mutex);
+        size_t res = 0;
+        for_each_keys([&](const std::vector<key> &keys)
+                      { res += Sentence::text_size(keys); });
+        return res;
+    }
+
+    /**
+     * @brief Writes the book text into a buffer of at least `text_size()` bytes and returns the end of what was written.
+     */
+    char *write(char *out)
+    {
+        std::lock_guard<std::mutex> lock(text_mutex);
+        for_each_keys([&](const std::vector<key> &keys)
+                      { out = Sentence::write(keys, out); });
+        return out;
+    }
+
+    /**
+     * @brief Writes the book text to the stream without building it in memory first.
+     */
+    void write(std::ostream &os)
+    {
+        std::lock_guard<std::mutex> lock(text_mutex);
+        for_each_keys([&](const std::vector<key> &keys)
+                      { Sentence::write(keys, os); });
+    }
+
+    /**
+     * @brief Get the book text as the string.
+     */
+    std::string get_text()
+    {
+        std::lock_guard<std::mutex> lock(text_mutex);
+        size_t size = 0;
+        for_each_keys([&](const std::vector<key> &keys)
+                      { size += Sentence::text_size(keys); });
+
+        std::string res(size, ' ');
+        char *out = res.data();
+        for_each_keys([&](const std::vector<key> &keys)
+                      { out = Sentence::write(keys, out); });
+        return res;
+    }
+};
@@ -0,0 +1,94 @@
+#pragma once
+#include "Encoding.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Sentences re-encoded by a compaction pass, as a stream of variable-length codes.
+ * Words are renumbered by how often they appear so that the most frequent ones get the smallest codes,
+ * and every code is stored as a varint i.e. the 128 most frequent words take a single byte.
+ */
+class CompactText
+{
+public:
+    using key = uint32_t;
+
+    CompactText()
+    {
+        offsets.push_back(0);
+    }
+
+    /**
+     * @brief Builds the text from all the sentences yielded by `for_each(f)`, where f is called with the keys of each sentence.
+     */
+    template <typename ForEach>
+    static CompactText build(ForEach &&for_each)
+    {
+        // Keys are close to dense, so the counts are kept in a plain array indexed by key.
+        std::vector<uint64_t> counts;
+        for_each([&](const std::vector<key> &keys)
+                 {
+            for (auto word_key : keys)
+            {
+                if (word_key >= counts.size())
+                    counts.resize(word_key + 1);
+                counts[word_key]++;
+            } });
+
+        CompactText res;
+        for (key word_key = 0; word_key < counts.size(); word_key++)
+            if (counts[word_key])
+                res.dictionary.push_back(word_key);
+        std::stable_sort(res.dictionary.begin(), res.dictionary.end(), [&](key a, key b)
+                         { return counts[a] > counts[b]; });
+
+        std::vector<key> code_of(counts.size());
+        for (key code = 0; code < res.dictionary.size(); code++)
+            code_of[res.dictionary[code]] = code;
+
+        for_each([&](const std::vector<key> &keys)
+                 {
+            put_varint(res.codes, keys.size());
+            for (auto word_key : keys)
+                put_varint(res.codes, code_of[word_key]);
+            res.offsets.push_back(res.codes.size()); });
+
+        res.dictionary.shrink_to_fit();
+        res.codes.shrink_to_fit();
+        res.offsets.shrink_to_fit();
+        return res;
+    }
+
+    // Number of sentences.
+    size_t size() const
+    {
+        return offsets.size() - 1;
+    }
+
+    /**
+     * @brief Decodes the keys of the given sentence into `keys`, replacing what it held.
+     */
+    void decode(size_t sentence, std::vector<key> &keys) const
+    {
+        const uint8_t *pos = codes.data() + offsets[sentence];
+        keys.resize(get_varint(pos));
+        for (auto &word_key : keys)
+            word_key = dictionary[get_varint(pos)];
+    }
+
+    // Bytes held by the dictionary, the codes and the sentence offsets.
+    size_t memory() const
+    {
+        return dictionary.capacity() * sizeof(key) + codes.capacity() + offsets.capacity() * sizeof(uint64_t);
+    }
+
+private:
+    // Word key of every code, most frequent word first.
+    std::vector<key> dictionary;
+    // Length and codes of every sentence as varints, back to back.
+    std::vector<uint8_t> codes;
+    // Start of every sentence in `codes`, followed by the end of the last one.
+    std::vector<uint64_t> offsets;
+};
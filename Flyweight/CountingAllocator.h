@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+/**
+ * @brief Replaces the global operator new and delete so that every heap allocation of the program is counted.
+ * Used by the benchmarks and tests to check the memory reports against what was actually allocated.
+ * !@warning Include it in exactly one translation unit of the program i.e. the one with main().
+ */
+
+// Bytes currently allocated through operator new.
+static std::atomic<size_t> live_bytes{0};
+// Number of calls made to operator new so far.
+static std::atomic<size_t> allocation_count{0};
+
+static void *counted_new(size_t size, size_t align)
+{
+    // The pointer returned by malloc and the requested size are stored right before the aligned block.
+    constexpr size_t header = 2 * sizeof(size_t);
+    align = align < alignof(std::max_align_t) ? alignof(std::max_align_t) : align;
+    auto raw = static_cast<char *>(std::malloc(size + header + align));
+    if (raw == nullptr)
+        throw std::bad_alloc();
+
+    uintptr_t start = (reinterpret_cast<uintptr_t>(raw) + header + align - 1) & ~(uintptr_t(align) - 1);
+    auto meta = reinterpret_cast<size_t *>(start) - 2;
+    meta[0] = reinterpret_cast<size_t>(raw);
+    meta[1] = size;
+    live_bytes += size;
+    allocation_count++;
+    return reinterpret_cast<void *>(start);
+}
+
+static void counted_delete(void *ptr) noexcept
+{
+    if (ptr == nullptr)
+        return;
+    auto meta = static_cast<size_t *>(ptr) - 2;
+    live_bytes -= meta[1];
+    std::free(reinterpret_cast<void *>(meta[0]));
+}
+
+void *operator new(size_t size)
+{
+    return counted_new(size, alignof(std::max_align_t));
+}
+
+void *operator new(size_t size, std::align_val_t align)
+{
+    return counted_new(size, static_cast<size_t>(align));
+}
+
+void operator delete(void *ptr) noexcept
+{
+    counted_delete(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    counted_delete(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+    counted_delete(ptr);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept
+{
+    counted_delete(ptr);
+}
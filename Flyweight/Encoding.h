@@ -0,0 +1,118 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Helpers shared by the on-disk formats of the Flyweight classes.
+ * Fixed-size integers are always little-endian and variable-size integers use LEB128 i.e. 7 bits per byte.
+ */
+
+inline void put_u32(std::ostream &os, uint32_t value)
+{
+    char bytes[4];
+    for (int i = 0; i < 4; i++)
+        bytes[i] = static_cast<char>(value >> (8 * i));
+    os.write(bytes, 4);
+}
+
+inline void put_u64(std::ostream &os, uint64_t value)
+{
+    put_u32(os, static_cast<uint32_t>(value));
+    put_u32(os, static_cast<uint32_t>(value >> 32));
+}
+
+// Calls `put(byte)` for every byte of the varint.
+template <typename Put>
+inline void encode_varint(uint64_t value, Put &&put)
+{
+    while (value >= 0x80)
+    {
+        put(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    put(static_cast<uint8_t>(value));
+}
+
+// Decodes a varint from the bytes returned by successive calls to `next()`.
+template <typename Next>
+inline uint64_t decode_varint(Next &&next)
+{
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        uint8_t byte = next();
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (byte < 0x80)
+            return value;
+    }
+    throw std::runtime_error("Malformed varint.");
+}
+
+inline void put_varint(std::ostream &os, uint64_t value)
+{
+    encode_varint(value, [&](uint8_t byte)
+                  { os.put(static_cast<char>(byte)); });
+}
+
+inline void put_varint(std::vector<uint8_t> &out, uint64_t value)
+{
+    encode_varint(value, [&](uint8_t byte)
+                  { out.push_back(byte); });
+}
+
+/**
+ * @brief Reads a varint from memory known to hold a whole one, such as a buffer filled by `put_varint`, and moves `pos` past it.
+ */
+inline uint64_t get_varint(const uint8_t *&pos)
+{
+    return decode_varint([&]
+                         { return *pos++; });
+}
+
+/**
+ * @brief Reads values back from a buffer, usually a memory mapped file, throwing if the buffer ends too early.
+ */
+class ByteReader
+{
+    std::string_view bytes;
+    size_t pos{0};
+
+public:
+    explicit ByteReader(std::string_view bytes) : bytes(bytes) {}
+
+    uint32_t get_u32()
+    {
+        auto data = reinterpret_cast<const unsigned char *>(take(4).data());
+        return uint32_t(data[0]) | uint32_t(data[1]) << 8 | uint32_t(data[2]) << 16 | uint32_t(data[3]) << 24;
+    }
+
+    uint64_t get_u64()
+    {
+        uint64_t low = get_u32();
+        return low | uint64_t(get_u32()) << 32;
+    }
+
+    uint64_t get_varint()
+    {
+        return decode_varint([&]
+                             { return static_cast<uint8_t>(take(1)[0]); });
+    }
+
+    // Returns the next `size` bytes as a view into the buffer.
+    std::string_view take(size_t size)
+    {
+        if (size > bytes.size() - pos)
+            throw std::runtime_error("Unexpected end of data.");
+        std::string_view res = bytes.substr(pos, size);
+        pos += size;
+        return res;
+    }
+
+    size_t remaining() const
+    {
+        return bytes.size() - pos;
+    }
+};
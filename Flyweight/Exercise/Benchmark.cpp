@@ -0,0 +1,89 @@
+/**
+ * @brief Benchmarks formatting of the exercise Sentence against the map-based version it replaced.
+ */
+
+#include "Exercise.cpp"
+#include <chrono>
+#include <map>
+
+/**
+ * @brief Previous Sentence that kept the formatting tokens in a map and copied every word before joining them.
+ */
+struct MapSentence
+{
+    vector<string> words;
+    map<int, Sentence::WordToken> tokens;
+
+    MapSentence(const string &text)
+    {
+        istringstream iss{text};
+        words = vector<string>(istream_iterator<string>{iss}, istream_iterator<string>{});
+    }
+
+    Sentence::WordToken &operator[](size_t index)
+    {
+        tokens[index] = Sentence::WordToken{};
+        return tokens[index];
+    }
+
+    string str() const
+    {
+        vector<string> ws;
+        for (size_t i = 0; i < words.size(); ++i)
+        {
+            string w = words[i];
+            auto t = tokens.find(i);
+            if (t != tokens.end() && t->second.capitalize)
+                transform(w.begin(), w.end(), w.begin(), (int (&)(int))toupper);
+            ws.push_back(w);
+        }
+
+        ostringstream oss;
+        for (size_t i = 0; i < ws.size(); ++i)
+        {
+            oss << ws[i];
+            if (i + 1 != ws.size())
+                oss << " ";
+        }
+        return oss.str();
+    }
+};
+
+// Formats every sentence `rounds` times with a couple of capitalized words and returns nanoseconds per str() call.
+template <typename S, typename Format>
+double time_format(vector<S> &sentences, int rounds, size_t &checksum, Format &&format)
+{
+    for (auto &s : sentences)
+    {
+        s[1].capitalize = true;
+        s[3].capitalize = true;
+    }
+    auto start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (auto &s : sentences)
+            checksum += format(s);
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double, nano>(end - start).count() / (rounds * sentences.size());
+}
+
+int main()
+{
+    const string text = "the quick brown fox jumps over the lazy dog";
+    vector<MapSentence> map_sentences(10000, MapSentence{text});
+    vector<Sentence> sentences(10000, Sentence{text});
+    size_t checksum = 0;
+
+    double map_ns = time_format(map_sentences, 100, checksum, [](const MapSentence &s)
+                                { return s.str().size(); });
+    double flat_ns = time_format(sentences, 100, checksum, [](const Sentence &s)
+                                 { return s.str().size(); });
+    string buffer;
+    double buffer_ns = time_format(sentences, 100, checksum, [&](const Sentence &s)
+                                   { s.str(buffer); return buffer.size(); });
+
+    cout << "map tokens, ostringstream :: " << map_ns << " ns/sentence\n";
+    cout << "flat tokens, str()        :: " << flat_ns << " ns/sentence\n";
+    cout << "flat tokens, str(buffer)  :: " << buffer_ns << " ns/sentence\n";
+    cout << "Checksum :: " << checksum << "\n";
+    return 0;
+}
@@ -1,7 +1,6 @@
 #include <algorithm>
 #include <iostream>
 #include <iterator>
-#include <map>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -16,43 +15,51 @@ struct Sentence
     };
 
     vector<string> words;
-    map<int, WordToken> tokens;
+    // One formatting token per word, indexed like `words` so no lookup is needed.
+    vector<WordToken> tokens;
 
     Sentence(const string &text)
     {
         istringstream iss{text};
         words = vector<string>(istream_iterator<string>{iss}, istream_iterator<string>{});
+        tokens.resize(words.size());
     }
 
+    // Throws std::out_of_range for an index past the last word.
     WordToken &operator[](size_t index)
     {
-        tokens[index] = WordToken{};
-        return tokens[index];
+        WordToken &token = tokens.at(index);
+        token = WordToken{};
+        return token;
     }
 
-    string str() const
+    // Writes the formatted sentence into `out`, reusing its capacity so that a warm buffer is never reallocated.
+    void str(string &out) const
     {
-        vector<string> ws;
+        size_t size = words.empty() ? 0 : words.size() - 1;
+        for (auto &w : words)
+            size += w.size();
+        out.clear();
+        out.reserve(size);
         for (size_t i = 0; i < words.size(); ++i)
         {
-            string w = words[i];
-            auto t = tokens.find(i);
-            if (t != tokens.end() && t->second.capitalize)
+            if (i)
+                out += ' ';
+            size_t begin = out.size();
+            out += words[i];
+            if (tokens[i].capitalize)
             {
                 // note: the annotation on ::toupper() below is only required
                 // for GCC; other compilers work fine without it
-                transform(w.begin(), w.end(), w.begin(), (int (&)(int))toupper);
+                transform(out.begin() + begin, out.end(), out.begin() + begin, (int (&)(int))toupper);
             }
-            ws.push_back(w);
         }
+    }
 
-        ostringstream oss;
-        for (size_t i = 0; i < ws.size(); ++i)
-        {
-            oss << ws[i];
-            if (i + 1 != ws.size())
-                oss << " ";
-        }
-        return oss.str();
+    string str() const
+    {
+        string res;
+        str(res);
+        return res;
     }
 };
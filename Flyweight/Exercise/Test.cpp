@@ -10,6 +10,13 @@ TEST(Evaluate, BaselineTest)
     ASSERT_EQ("alpha BETA gamma alpha", s.str());
 }
 
+TEST(Evaluate, IndexPastLastWord)
+{
+    Sentence s{"alpha beta"};
+    EXPECT_THROW(s[2], std::out_of_range);
+    ASSERT_EQ("alpha beta", s.str());
+}
+
 int main(int ac, char *av[])
 {
     testing::InitGoogleTest(&ac, av);
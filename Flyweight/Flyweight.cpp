@@ -5,163 +5,43 @@
  * @brief Flyweight Pattern can be exemplified by a Sentence class that rather than storing the whole text together stores pointer to each word present in it. This saves space as their maybe a lot of repeating words.
  */
 
-#include "boost\bimap.hpp"
-#include <cstdint>
-#include <fstream>
+#include "Book.h"
 #include <iostream>
-#include <map>
 #include <string>
-#include <vector>
 
-typedef uint32_t key;
-
-/**
- * @brief Monostate Word class that keeps track of all the unique words in a static `bimap`.
- *
- */
-class Word
-{
-    // Stores all the words along with seed.
-    static boost::bimap<key, std::string> words;
-    // Keeps count of all the unique words seen.
-    static key seed;
-
-public:
-    /**
-     * @brief Get the word stored int the map at the given key.
-     */
-    static std::string get_word(key word_key)
-    {
-        return words.left.find(word_key)->second;
-    }
-
-    /**
-     * @brief Stores the word in the map and returns the key.
-     */
-    static key add_word(std::string word)
-    {
-        auto word_key = words.right.find(word);
-        if (word_key != words.right.end())
-        {
-            return word_key->second;
-        }
-        words.insert({++seed, word});
-        return seed;
-    }
-
-    /**
-     * @brief Get the current memory size by the map.
-     */
-    static int get_map_memory()
-    {
-        int res = 0;
-        for (auto a : words)
-        {
-            res += a.right.size();
-            res += sizeof(a.left);
-        }
-        return res;
-    }
-};
-
-// Initialize the static members.
-boost::bimap<key, std::string> Word::words = {};
-key Word::seed = 0;
-
-/**
- * @brief Sentence stores each word as a key in the words map.
- */
-class Sentence
-{
-    std::vector<key> sentence_words;
-
-public:
-    /**
-     * @brief Construct a new Sentence object from the given string sentence.
-     */
-    Sentence(std::string sentence)
-    {
-        std::istringstream iss(sentence);
-        std::string token;
-
-        while (std::getline(iss, token, ' '))
-        {
-            std::string lim;
-            if (token.back() == '.' || token.back() == ',')
-            {
-                lim += token.back();
-                token.pop_back();
-            }
-            sentence_words.push_back(Word::add_word(token));
-            sentence_words.push_back(Word::add_word(lim));
-        }
-    }
-    /**
-     * @brief Resolves keys of the sentence to contruct the sentence string.
-     */
-    std::string get_sentence()
-    {
-        std::string res = "";
-        for (auto a : sentence_words)
-        {
-            std::string word = Word::get_word(a);
-            res += (word == "." || word == "," ? "" : " ");
-            res += word;
-        }
-        if (res.size())
-            res.erase(res.begin());
-        return res;
-    }
-};
-
-/**
- * @brief Collection of Sentences.
- */
-class Book
+int main()
 {
-    std::vector<Sentence> text;
+    Book b;
 
-public:
-    /**
-     * @brief Adds sentence string in to the book.
-     */
-    void add_Sentence(std::string sentence)
-    {
-        text.push_back(Sentence(sentence));
-    }
+    // Get sentences from the text file and add it to the Book, the file is mapped rather than read into memory.
+    size_t text_size = b.add_file("test.txt");
 
-    /**
-     * @brief Get the book text as the string.
-     */
-    std::string get_text()
+    // Without the Flyweight every word of every sentence would be a string object of its own, repeated words included.
+    size_t strings_size = 0;
+    WordStatistics counts = b.statistics();
+    for (auto [word_key, count] : counts.top_words(counts.frequencies.size()))
     {
-        std::string res;
-        for (auto a : text)
-        {
-            res += a.get_sentence();
-        }
-        return res;
+        // Short strings are kept inside the string object, longer ones take a heap block as well.
+        size_t length = Word::view_word(word_key).size();
+        strings_size += count * (sizeof(std::string) + (length > std::string().capacity() ? length + 1 : 0));
     }
-};
 
-int main()
-{
-    Book b;
-    std::string text = "";
+    // ! The words stored once along with sentences of keys take much less than a string per word.
+    std::cout << "Memory taken by the text :: " << text_size << " bytes.\n";
+    std::cout << "Memory taken by the text as a string per word :: " << strings_size << " bytes.\n";
+    std::cout << "Memory taken by the Flyweight text :: " << Word::get_map_memory() + b.memory().total() << " bytes.\n";
+    std::cout << "  Word :: " << Word::memory() << "\n";
+    std::cout << "  Book :: " << b.memory() << "\n";
 
-    // Get sentences from the text file and add it to the Book.
-    std::ifstream ifs("test.txt");
-    std::string sentence;
-    while (std::getline(ifs, sentence))
-    {
-        b.add_Sentence(sentence);
-        text += sentence;
-    }
+    // Renumbering the words by frequency shrinks the sentences further.
+    b.compact();
+    std::cout << "  Compacted Book :: " << b.memory() << "\n";
 
-    ifs.close();
-    // ! Size of the raw text is much larger than the size taken by the word_map.
-    std::cout << "Memory taken by the text :: " << text.size() << " bytes.\n";
-    std::cout << "Memory taken by the Flyweight text :: " << Word::get_map_memory() << " bytes.\n";
+    // Statistics are computed on the keys, the words are only looked up for printing.
+    std::cout << "Most frequent words ::";
+    for (auto [word_key, count] : b.statistics(2).top_words(5))
+        std::cout << " '" << Word::view_word(word_key) << "' x" << count;
+    std::cout << "\n";
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,125 @@
+/**
+ * @brief Measures how interning into the shared Word store scales with the number of threads.
+ * Kept apart from Benchmark.cpp, whose counting allocator makes every allocation update shared counters and would skew the scaling.
+ * Times lookups of words seen before, which lock nothing, against the same lookups under a per-shard shared lock as they used to be,
+ * then building a whole Book with 1..N threads from an empty Word store, which interns every word under the lock of its shard.
+ */
+
+#include "Book.h"
+#include "StringInterner.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Reads the lines of the text, repeated the given number of times.
+std::vector<std::string> read_sentences(const std::string &file, int repeat)
+{
+    std::vector<std::string> once;
+    std::ifstream ifs(file);
+    std::string sentence;
+    while (std::getline(ifs, sentence))
+        once.push_back(sentence);
+
+    std::vector<std::string> sentences;
+    sentences.reserve(once.size() * repeat);
+    for (int i = 0; i < repeat; i++)
+        sentences.insert(sentences.end(), once.begin(), once.end());
+    return sentences;
+}
+
+// Splits the sentences into words the same way Sentence does, as views of the words stored by `interner`.
+// Word is emptied afterwards, so that the Books built later intern every word themselves.
+std::vector<std::string_view> split_words(const std::vector<std::string> &sentences, ShardedStringInterner &interner)
+{
+    std::vector<std::string_view> words;
+    for (auto &text : sentences)
+    {
+        Sentence sentence(text);
+        for (auto word_key : sentence.keys())
+            words.push_back(interner.get(interner.intern(Word::view_word(word_key))));
+    }
+    Word::clear();
+    return words;
+}
+
+// Runs `f(thread, begin, end)` on `threads` threads, each with its own share of `count` items, and returns the nanoseconds per item.
+template <typename F>
+double time_parallel(size_t count, unsigned threads, F &&f)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++)
+        workers.emplace_back([&, t]
+                             { f(t, count * t / threads, count * (t + 1) / threads); });
+    for (auto &worker : workers)
+        worker.join();
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return elapsed / count;
+}
+
+int main()
+{
+    auto sentences = read_sentences("test.txt", 2000);
+    // Every word is interned once beforehand, so that the lookup runs below only look words up.
+    ShardedStringInterner interner;
+    auto words = split_words(sentences, interner);
+    unsigned max_threads = std::max(16u, std::thread::hardware_concurrency());
+    std::cout << "Hardware threads :: " << std::thread::hardware_concurrency() << ", words :: " << words.size() << "\n";
+
+    // The same lookups each taking the shared lock of their shard, which writes to the lock on every call.
+    std::array<std::shared_mutex, ShardedStringInterner::shard_count> locks;
+
+    std::vector<uint64_t> checksums(max_threads);
+    std::cout << "Threads :: lock-free ns/word, speedup :: shared lock ns/word, speedup\n";
+    double lock_free_single = 0, locked_single = 0;
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2)
+    {
+        double lock_free_ns = time_parallel(words.size(), threads, [&](unsigned thread, size_t begin, size_t end)
+                                            {
+            uint64_t sum = 0;
+            for (size_t i = begin; i < end; i++)
+                sum += interner.intern(words[i]);
+            checksums[thread] += sum; });
+        double locked_ns = time_parallel(words.size(), threads, [&](unsigned thread, size_t begin, size_t end)
+                                         {
+            uint64_t sum = 0;
+            for (size_t i = begin; i < end; i++)
+            {
+                std::shared_lock<std::shared_mutex> lock(locks[StringInterner::hash_of(words[i]) >> (32 - ShardedStringInterner::shard_bits)]);
+                sum += interner.find(words[i]);
+            }
+            checksums[thread] += sum; });
+        if (threads == 1)
+            lock_free_single = lock_free_ns, locked_single = locked_ns;
+        std::cout << threads << " :: " << lock_free_ns << ", " << lock_free_single / lock_free_ns << "x :: "
+                  << locked_ns << ", " << locked_single / locked_ns << "x\n";
+    }
+
+    // Builds the same Book with 1..N threads, every run starts from an empty Word store so that threads insert new words under the shard locks.
+    double single_ns = 0;
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2)
+    {
+        Word::clear();
+        Book book;
+        auto start = std::chrono::steady_clock::now();
+        book.add_Sentences(sentences, threads);
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / sentences.size();
+        if (threads == 1)
+            single_ns = ns;
+        std::cout << "Book with " << threads << " thread(s) :: " << ns << " ns/sentence, speedup " << single_ns / ns << "x\n";
+    }
+
+    uint64_t checksum = 0;
+    for (auto sum : checksums)
+        checksum += sum;
+    std::cout << "Checksum :: " << checksum << "\n";
+    return 0;
+}
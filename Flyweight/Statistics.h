@@ -0,0 +1,86 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Word frequencies and bigram counts of a text, computed on the word keys rather than the strings.
+ * Partial statistics gathered on different threads are merged with `+=`.
+ */
+struct WordStatistics
+{
+    using key = uint32_t;
+
+    // Occurrences of every word, indexed by its key as keys are close to dense.
+    std::vector<uint64_t> frequencies;
+    // Occurrences of every pair of consecutive words of a sentence, indexed by `bigram(first, second)`.
+    std::unordered_map<uint64_t, uint64_t> bigrams;
+
+    static uint64_t bigram(key first, key second)
+    {
+        return uint64_t(first) << 32 | second;
+    }
+
+    /**
+     * @brief Counts the words and bigrams of a sentence.
+     */
+    void add(const std::vector<key> &keys)
+    {
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            if (keys[i] >= frequencies.size())
+                frequencies.resize(keys[i] + 1);
+            frequencies[keys[i]]++;
+            if (i)
+                bigrams[bigram(keys[i - 1], keys[i])]++;
+        }
+    }
+
+    WordStatistics &operator+=(const WordStatistics &other)
+    {
+        if (other.frequencies.size() > frequencies.size())
+            frequencies.resize(other.frequencies.size());
+        for (size_t word_key = 0; word_key < other.frequencies.size(); word_key++)
+            frequencies[word_key] += other.frequencies[word_key];
+        for (auto &[pair, count] : other.bigrams)
+            bigrams[pair] += count;
+        return *this;
+    }
+
+    /**
+     * @brief Returns the `n` most frequent words along with their counts, most frequent first.
+     */
+    std::vector<std::pair<key, uint64_t>> top_words(size_t n) const
+    {
+        std::vector<std::pair<key, uint64_t>> res;
+        for (key word_key = 0; word_key < frequencies.size(); word_key++)
+            if (frequencies[word_key])
+                res.emplace_back(word_key, frequencies[word_key]);
+        return top(std::move(res), n);
+    }
+
+    /**
+     * @brief Returns the `n` most frequent bigrams along with their counts, most frequent first.
+     */
+    std::vector<std::pair<std::pair<key, key>, uint64_t>> top_bigrams(size_t n) const
+    {
+        std::vector<std::pair<std::pair<key, key>, uint64_t>> res;
+        for (auto &[pair, count] : bigrams)
+            res.push_back({{key(pair >> 32), key(pair)}, count});
+        return top(std::move(res), n);
+    }
+
+private:
+    template <typename T>
+    static std::vector<T> top(std::vector<T> counts, size_t n)
+    {
+        n = std::min(n, counts.size());
+        std::partial_sort(counts.begin(), counts.begin() + n, counts.end(), [](const T &a, const T &b)
+                          { return a.second != b.second ? a.second > b.second : a.first < b.first; });
+        counts.resize(n);
+        return counts;
+    }
+};
@@ -0,0 +1,625 @@
+#pragma once
+#include "Encoding.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Bytes held by an interner, split by what they are used for.
+ */
+struct InternerMemory
+{
+    // Characters of the strings copied into the arena blocks.
+    size_t arena{0};
+    // Characters of the strings used straight from a loaded buffer, these are not on the heap.
+    size_t mapped{0};
+    // Key to string table along with the list of arena blocks.
+    size_t views{0};
+    // Cached hashes and the open-addressing slots.
+    size_t index{0};
+    // The interner objects themselves.
+    size_t objects{0};
+
+    // Bytes owned by the interner, everything except the mapped strings.
+    size_t total() const
+    {
+        return arena + views + index + objects;
+    }
+
+    InternerMemory &operator+=(const InternerMemory &other)
+    {
+        arena += other.arena;
+        mapped += other.mapped;
+        views += other.views;
+        index += other.index;
+        objects += other.objects;
+        return *this;
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const InternerMemory &m)
+    {
+        return os << "arena " << m.arena << ", views " << m.views << ", index " << m.index << ", objects "
+                  << m.objects << " = " << m.total() << " bytes (+" << m.mapped << " mapped)";
+    }
+};
+
+/**
+ * @brief Append-only table of string views split into pages that double in size and never move.
+ * A single writer appends while any number of readers index it without locking, as long as readers only use indices handed to them after the append.
+ */
+class ViewTable
+{
+    static constexpr unsigned first_page_bits = 4;
+    static constexpr unsigned page_count = 32 - first_page_bits + 1;
+
+    std::array<std::atomic<std::string_view *>, page_count> pages{};
+    size_t count{0};
+    size_t allocated{0};
+
+    // Page i holds 2^(i + first_page_bits) views, starting right after the views of the pages before it.
+    static void locate(size_t index, unsigned &page, size_t &offset)
+    {
+        uint64_t biased = index + (uint64_t(1) << first_page_bits);
+#if defined(__GNUC__)
+        unsigned top = 63 - __builtin_clzll(biased);
+#else
+        unsigned top = 0;
+        for (unsigned step = 32; step; step /= 2)
+            if (biased >> (top + step))
+                top += step;
+#endif
+        page = top - first_page_bits;
+        offset = static_cast<size_t>(biased - (uint64_t(1) << top));
+    }
+
+public:
+    ViewTable() = default;
+    ViewTable(const ViewTable &) = delete;
+    ViewTable &operator=(const ViewTable &) = delete;
+
+    ~ViewTable()
+    {
+        clear();
+    }
+
+    std::string_view operator[](size_t index) const
+    {
+        unsigned page;
+        size_t offset;
+        locate(index, page, offset);
+        return pages[page].load(std::memory_order_acquire)[offset];
+    }
+
+    void push_back(std::string_view view)
+    {
+        unsigned page;
+        size_t offset;
+        locate(count, page, offset);
+        std::string_view *views = pages[page].load(std::memory_order_relaxed);
+        if (views == nullptr)
+        {
+            size_t size = size_t(1) << (page + first_page_bits);
+            views = new std::string_view[size];
+            allocated += size;
+            pages[page].store(views, std::memory_order_release);
+        }
+        views[offset] = view;
+        count++;
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    // Bytes held by the pages allocated so far.
+    size_t memory() const
+    {
+        return allocated * sizeof(std::string_view);
+    }
+
+    void clear()
+    {
+        for (auto &page : pages)
+            delete[] page.exchange(nullptr);
+        count = 0;
+        allocated = 0;
+    }
+};
+
+/**
+ * @brief Flat string interner that stores every unique string once in an append-only arena.
+ * Keys are dense indices handed out in the order of first appearance.
+ * An open-addressing hash index maps the string back to its key, so lookups are O(1) on average in both directions.
+ * The arena grows in blocks that never move, so views returned by `get` stay valid for the lifetime of the interner.
+ * A single writer may intern while any number of threads call `find` and `get` without locking:
+ * slots are atomics written once, and a grown index is published whole while the previous ones are kept until `clear`.
+ * An interner can be saved and loaded back from a memory mapped file, in which case the strings are used straight from the mapping.
+ */
+class StringInterner
+{
+public:
+    using key = uint32_t;
+
+    // Returned by `find` for unknown strings.
+    static constexpr key npos = UINT32_MAX;
+
+    /**
+     * @brief Returns the key of the given string, storing it in the arena if it was not seen before.
+     */
+    key intern(std::string_view word)
+    {
+        return intern(word, hash_of(word));
+    }
+
+    // Same as above for callers that have already hashed the string.
+    key intern(std::string_view word, uint32_t hash)
+    {
+        Index *current = index.load(std::memory_order_relaxed);
+        if (current == nullptr)
+            current = rehash(16);
+        uint64_t entry;
+        size_t slot = probe(*current, word, hash, entry);
+        if (entry != empty_slot)
+            return static_cast<key>(entry);
+
+        // Keys stay below npos, which marks unknown strings and empty slots.
+        if (words.size() >= npos)
+            throw std::length_error("Too many strings in the interner.");
+        key word_key = static_cast<key>(words.size());
+        words.push_back(store(word));
+        // Released so that a reader finding the key also sees the view it refers to.
+        current->slots[slot].store(uint64_t(hash) << 32 | word_key, std::memory_order_release);
+
+        // Keeps the load factor under 3/4, probes compare the hashes held in the slots so that longer probe sequences stay cheap.
+        // Every outgrown index is kept, so growing later rather than sooner also saves all the indexes left behind.
+        if (words.size() * 4 > (current->mask + 1) * 3)
+            rehash((current->mask + 1) * 2);
+        return word_key;
+    }
+
+    /**
+     * @brief Returns the key of the given string or `npos` if it was never interned.
+     */
+    key find(std::string_view word) const
+    {
+        return find(word, hash_of(word));
+    }
+
+    key find(std::string_view word, uint32_t hash) const
+    {
+        const Index *current = index.load(std::memory_order_acquire);
+        if (current == nullptr)
+            return npos;
+        uint64_t entry;
+        probe(*current, word, hash, entry);
+        return static_cast<key>(entry);
+    }
+
+    /**
+     * @brief Returns the string stored at the given key.
+     */
+    std::string_view get(key word_key) const
+    {
+        return words[word_key];
+    }
+
+    // Number of unique strings interned so far.
+    size_t size() const
+    {
+        return words.size();
+    }
+
+    // Bytes held by the interner, counting reserved capacity rather than used size.
+    InternerMemory memory() const
+    {
+        InternerMemory res;
+        res.arena = arena_bytes;
+        res.mapped = mapped_bytes;
+        res.views = words.memory() + blocks.capacity() * sizeof(std::unique_ptr<char[]>);
+        res.index = indexes.capacity() * sizeof(std::unique_ptr<Index>);
+        for (auto &kept : indexes)
+            res.index += sizeof(Index) + (kept->mask + 1) * sizeof(std::atomic<uint64_t>);
+        res.objects = sizeof(StringInterner);
+        return res;
+    }
+
+    /**
+     * @brief Writes the strings along with their hashes, so that loading them back does not need to hash anything.
+     */
+    void save(std::ostream &os) const
+    {
+        // Offsets into the characters are saved as 32 bits.
+        uint64_t chars = 0;
+        for (key word_key = 0; word_key < words.size(); word_key++)
+            chars += words[word_key].size();
+        if (chars > UINT32_MAX)
+            throw std::length_error("Too many characters to save the interner.");
+
+        // Hashes are only kept in the index, they are put back in key order.
+        std::vector<uint32_t> hashes(words.size());
+        if (const Index *current = index.load(std::memory_order_relaxed))
+            for (size_t slot = 0; slot <= current->mask; slot++)
+            {
+                uint64_t entry = current->slots[slot].load(std::memory_order_relaxed);
+                if (entry != empty_slot)
+                    hashes[static_cast<key>(entry)] = static_cast<uint32_t>(entry >> 32);
+            }
+
+        put_u32(os, static_cast<uint32_t>(words.size()));
+        put_u32(os, static_cast<uint32_t>(chars));
+        for (auto hash : hashes)
+            put_u32(os, hash);
+        uint32_t offset = 0;
+        put_u32(os, offset);
+        for (key word_key = 0; word_key < words.size(); word_key++)
+            put_u32(os, offset += static_cast<uint32_t>(words[word_key].size()));
+        for (key word_key = 0; word_key < words.size(); word_key++)
+            os.write(words[word_key].data(), words[word_key].size());
+    }
+
+    /**
+     * @brief Adopts the strings written by `save` without copying them, `storage` keeps the underlying buffer alive.
+     * !@warning Only an empty interner can be loaded into, as the keys are taken over as they are.
+     */
+    void load(ByteReader &reader, std::shared_ptr<const void> storage)
+    {
+        if (words.size() != 0)
+            throw std::logic_error("Strings can only be loaded into an empty interner.");
+
+        uint32_t count = reader.get_u32();
+        uint32_t chars_size = reader.get_u32();
+        ByteReader hash_reader(reader.take(size_t(count) * 4));
+        ByteReader offset_reader(reader.take((size_t(count) + 1) * 4));
+        std::string_view chars = reader.take(chars_size);
+
+        size_t capacity = 16;
+        while (capacity * 3 < size_t(count) * 4)
+            capacity *= 2;
+        auto loaded = std::make_unique<Index>(capacity);
+
+        uint32_t begin = offset_reader.get_u32();
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t end = offset_reader.get_u32();
+            if (begin > end || end > chars_size)
+                throw std::runtime_error("Corrupt string offsets.");
+            words.push_back(chars.substr(begin, end - begin));
+            loaded->insert(uint64_t(hash_reader.get_u32()) << 32 | i);
+            begin = end;
+        }
+        external = std::move(storage);
+        mapped_bytes += chars_size;
+        index.store(loaded.get(), std::memory_order_release);
+        indexes.push_back(std::move(loaded));
+    }
+
+    /**
+     * @brief Forgets all the strings, invalidating every key and view handed out so far.
+     * !@warning Unlike `intern`, must not run while other threads look strings up.
+     */
+    void clear()
+    {
+        blocks.clear();
+        block_size = block_used = arena_bytes = mapped_bytes = 0;
+        external.reset();
+        words.clear();
+        index.store(nullptr, std::memory_order_relaxed);
+        indexes.clear();
+    }
+
+    /**
+     * @brief FNV-1a hash, fixed across platforms so that saved hashes stay valid wherever they are loaded.
+     */
+    static uint32_t hash_of(std::string_view word)
+    {
+        uint32_t hash = 2166136261u;
+        for (char c : word)
+        {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+private:
+    // The first block is small so that an interner holding a few strings, such as a shard of a small text, does not reserve much more than it holds.
+    static constexpr size_t min_block_size = 64;
+    static constexpr size_t max_block_size = 64 * 1024;
+    // An empty slot has no valid key, as keys never reach npos.
+    static constexpr uint64_t empty_slot = npos;
+
+    /**
+     * @brief Open-addressing table from string to key, whose size is a power of two.
+     * Every slot holds the hash of its string in the high half and its key in the low half, so probing compares hashes without looking anything else up.
+     */
+    struct Index
+    {
+        size_t mask;
+        std::unique_ptr<std::atomic<uint64_t>[]> slots;
+
+        explicit Index(size_t capacity) : mask(capacity - 1), slots(new std::atomic<uint64_t>[capacity])
+        {
+            for (size_t slot = 0; slot < capacity; slot++)
+                slots[slot].store(empty_slot, std::memory_order_relaxed);
+        }
+
+        // Puts an entry in the first empty slot of its probe sequence, for a table no reader sees yet.
+        void insert(uint64_t entry)
+        {
+            size_t slot = static_cast<uint32_t>(entry >> 32) & mask;
+            while (slots[slot].load(std::memory_order_relaxed) != empty_slot)
+                slot = (slot + 1) & mask;
+            slots[slot].store(entry, std::memory_order_relaxed);
+        }
+    };
+
+    // Blocks of characters holding all the unique strings back to back.
+    std::vector<std::unique_ptr<char[]>> blocks;
+    size_t block_size{0};
+    size_t block_used{0};
+    size_t arena_bytes{0};
+    // Keeps alive the buffer that loaded strings point into.
+    std::shared_ptr<const void> external;
+    size_t mapped_bytes{0};
+    // View of every string in the arena, indexed by key.
+    ViewTable words;
+    // Index probed by lookups, allocated on the first intern.
+    std::atomic<Index *> index{nullptr};
+    // Every index allocated so far, the last one being current. Outgrown ones are kept as readers may still be probing them, they take less than the current one altogether.
+    std::vector<std::unique_ptr<Index>> indexes;
+
+    // Copies the string at the end of the arena, starting a new block when the current one is full.
+    std::string_view store(std::string_view word)
+    {
+        if (blocks.empty() || block_used + word.size() > block_size)
+        {
+            // Blocks double in size up to a limit, strings longer than that get a block of their own.
+            block_size = std::max(std::clamp(arena_bytes, min_block_size, max_block_size), word.size());
+            blocks.push_back(std::make_unique<char[]>(block_size));
+            arena_bytes += block_size;
+            block_used = 0;
+        }
+        char *dest = blocks.back().get() + block_used;
+        std::memcpy(dest, word.data(), word.size());
+        block_used += word.size();
+        return std::string_view(dest, word.size());
+    }
+
+    // Linear probing until either the string or an empty slot is found, returns the slot and sets `entry` to what it holds.
+    size_t probe(const Index &table, std::string_view word, uint32_t hash, uint64_t &entry) const
+    {
+        for (size_t slot = hash & table.mask;; slot = (slot + 1) & table.mask)
+        {
+            entry = table.slots[slot].load(std::memory_order_acquire);
+            if (entry == empty_slot || (static_cast<uint32_t>(entry >> 32) == hash && words[static_cast<key>(entry)] == word))
+                return slot;
+        }
+    }
+
+    // Moves every entry to a new index of the given capacity and publishes it.
+    Index *rehash(size_t capacity)
+    {
+        auto grown = std::make_unique<Index>(capacity);
+        if (const Index *current = index.load(std::memory_order_relaxed))
+            for (size_t slot = 0; slot <= current->mask; slot++)
+            {
+                uint64_t entry = current->slots[slot].load(std::memory_order_relaxed);
+                if (entry != empty_slot)
+                    grown->insert(entry);
+            }
+        Index *res = grown.get();
+        indexes.push_back(std::move(grown));
+        index.store(res, std::memory_order_release);
+        return res;
+    }
+};
+
+/**
+ * @brief Thread-safe interner made of lock-striped `StringInterner` shards.
+ * Strings seen before are found without taking any lock nor writing any shared memory, so threads looking up the same words do not contend.
+ * New strings take the lock of the shard picked by the top bits of their hash, so threads adding different words rarely contend either.
+ * The shard is encoded in the low bits of the key, which keeps the keys stable and close to dense.
+ */
+class ShardedStringInterner
+{
+public:
+    using key = StringInterner::key;
+
+    static constexpr unsigned shard_bits = 4;
+    static constexpr key shard_count = 1 << shard_bits;
+    static constexpr key npos = StringInterner::npos;
+    // Strings a shard can hold, so that no key wraps around nor reaches npos.
+    static constexpr key max_shard_size = npos >> shard_bits;
+
+    // Number of strings in each shard, as loaded by `load`.
+    using ShardSizes = std::array<key, shard_count>;
+
+    // Whether the key refers to a string of shards holding `sizes` strings.
+    static bool within(key word_key, const ShardSizes &sizes)
+    {
+        return (word_key >> shard_bits) < sizes[word_key & (shard_count - 1)];
+    }
+
+    /**
+     * @brief Returns the key of the given string, storing it in its shard if it was not seen before.
+     */
+    key intern(std::string_view word)
+    {
+        uint32_t hash = StringInterner::hash_of(word);
+        key shard_index = hash >> (32 - shard_bits);
+        Shard &shard = make_shard(shard_index);
+        // Most words have been seen before, so they are looked up before locking.
+        key local = shard.words.find(word, hash);
+        if (local != npos)
+            return (local << shard_bits) | shard_index;
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        // Keys keep the shard in their low bits, a shard holding all the local keys that fit in the rest only finds what it has.
+        if (shard.words.size() >= max_shard_size)
+        {
+            local = shard.words.find(word, hash);
+            if (local == npos)
+                throw std::length_error("Too many strings in an interner shard.");
+            return (local << shard_bits) | shard_index;
+        }
+        return (shard.words.intern(word, hash) << shard_bits) | shard_index;
+    }
+
+    /**
+     * @brief Returns the key of the given string or `npos` if it was never interned.
+     */
+    key find(std::string_view word) const
+    {
+        uint32_t hash = StringInterner::hash_of(word);
+        key shard_index = hash >> (32 - shard_bits);
+        const Shard *shard = shards[shard_index].load(std::memory_order_acquire);
+        key local = shard ? shard->words.find(word, hash) : npos;
+        return local == npos ? npos : (local << shard_bits) | shard_index;
+    }
+
+    /**
+     * @brief Returns the string stored at the given key.
+     * Does not lock, as the key table of a shard never moves and the key was handed out after its entry was written.
+     */
+    std::string_view get(key word_key) const
+    {
+        return shards[word_key & (shard_count - 1)].load(std::memory_order_acquire)->words.get(word_key >> shard_bits);
+    }
+
+    /**
+     * @brief Calls `f(key, word)` for every string interned so far, shard by shard.
+     */
+    template <typename F>
+    void for_each(F &&f) const
+    {
+        for (key shard_index = 0; shard_index < shard_count; shard_index++)
+        {
+            const Shard *shard = shards[shard_index].load(std::memory_order_acquire);
+            if (shard == nullptr)
+                continue;
+            std::shared_lock<std::shared_mutex> lock(shard->mutex);
+            for (key local = 0; local < shard->words.size(); local++)
+                f((local << shard_bits) | shard_index, shard->words.get(local));
+        }
+    }
+
+    /**
+     * @brief Writes every shard one after the other.
+     */
+    void save(std::ostream &os) const
+    {
+        put_u32(os, shard_count);
+        for (auto &slot : shards)
+        {
+            const Shard *shard = slot.load(std::memory_order_acquire);
+            if (shard == nullptr)
+            {
+                StringInterner().save(os);
+                continue;
+            }
+            std::shared_lock<std::shared_mutex> lock(shard->mutex);
+            shard->words.save(os);
+        }
+    }
+
+    /**
+     * @brief Adopts the shards written by `save`, keys stay the same as when they were saved.
+     * Returns the number of strings loaded into each shard, against which saved keys can be checked.
+     */
+    ShardSizes load(ByteReader &reader, std::shared_ptr<const void> storage)
+    {
+        if (reader.get_u32() != shard_count)
+            throw std::runtime_error("Saved interner has a different number of shards.");
+        ShardSizes sizes{};
+        for (key shard_index = 0; shard_index < shard_count; shard_index++)
+        {
+            Shard &shard = make_shard(shard_index);
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            shard.words.load(reader, storage);
+            sizes[shard_index] = static_cast<key>(shard.words.size());
+        }
+        return sizes;
+    }
+
+    /**
+     * @brief Forgets all the strings and frees the shards.
+     * !@warning Invalidates every key and view handed out so far, and unlike `intern` must not run while other threads use the interner.
+     */
+    void clear()
+    {
+        for (auto &slot : shards)
+            delete slot.exchange(nullptr);
+    }
+
+    // Number of unique strings interned so far.
+    size_t size() const
+    {
+        size_t res = 0;
+        for (auto &slot : shards)
+            if (const Shard *shard = slot.load(std::memory_order_acquire))
+            {
+                std::shared_lock<std::shared_mutex> lock(shard->mutex);
+                res += shard->words.size();
+            }
+        return res;
+    }
+
+    // Bytes held by the interner along with the shards allocated so far.
+    InternerMemory memory() const
+    {
+        InternerMemory res;
+        res.objects = sizeof(ShardedStringInterner);
+        for (auto &slot : shards)
+            if (const Shard *shard = slot.load(std::memory_order_acquire))
+            {
+                std::shared_lock<std::shared_mutex> lock(shard->mutex);
+                InternerMemory words = shard->words.memory();
+                // The interner object is part of its shard.
+                words.objects = sizeof(Shard);
+                res += words;
+            }
+        return res;
+    }
+
+    ShardedStringInterner() = default;
+    ShardedStringInterner(const ShardedStringInterner &) = delete;
+    ShardedStringInterner &operator=(const ShardedStringInterner &) = delete;
+
+    ~ShardedStringInterner()
+    {
+        clear();
+    }
+
+private:
+    // Each shard sits on its own cache line so that locking one does not slow down its neighbours.
+    struct alignas(64) Shard
+    {
+        mutable std::shared_mutex mutex;
+        StringInterner words;
+    };
+
+    // Shards are allocated on their first string, so that a small interner only pays for the shards it uses.
+    std::array<std::atomic<Shard *>, shard_count> shards{};
+
+    // Returns the shard, allocating it if no thread has yet.
+    Shard &make_shard(key shard_index)
+    {
+        Shard *shard = shards[shard_index].load(std::memory_order_acquire);
+        if (shard != nullptr)
+            return *shard;
+        auto created = std::make_unique<Shard>();
+        if (shards[shard_index].compare_exchange_strong(shard, created.get(), std::memory_order_acq_rel, std::memory_order_acquire))
+            return *created.release();
+        return *shard;
+    }
+};
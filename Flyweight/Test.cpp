@@ -0,0 +1,338 @@
+#include "Book.h"
+#include "CountingAllocator.h"
+#include "gtest/gtest.h"
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Words used by the tests, enough of them to make the interners grow a few times.
+static std::string nth_word(int i)
+{
+    return "word" + std::to_string(i * 7919);
+}
+
+TEST(MemoryReport, StringInternerMatchesAllocations)
+{
+    size_t before = live_bytes;
+    auto words = std::make_unique<StringInterner>();
+    for (int i = 0; i < 5000; i++)
+        words->intern(nth_word(i % 3000));
+    ASSERT_EQ(live_bytes - before, words->memory().total());
+}
+
+TEST(StringInterner, KeysRoundTripAndStayStable)
+{
+    auto words = std::make_unique<StringInterner>();
+    EXPECT_EQ(words->find("word0"), StringInterner::npos);
+    auto empty = words->intern("");
+    EXPECT_EQ(words->get(empty), "");
+
+    // Enough words for the index to be rehashed and the key table to grow by several pages.
+    std::vector<StringInterner::key> keys;
+    for (int i = 0; i < 5000; i++)
+        keys.push_back(words->intern(nth_word(i)));
+    ASSERT_EQ(words->size(), 5001u);
+    for (int i = 0; i < 5000; i++)
+    {
+        std::string word = nth_word(i);
+        // Keys are dense and in order of first appearance, the empty string came first.
+        ASSERT_EQ(keys[i], StringInterner::key(i + 1));
+        ASSERT_EQ(words->intern(word), keys[i]);
+        ASSERT_EQ(words->find(word), keys[i]);
+        ASSERT_EQ(words->get(keys[i]), word);
+    }
+    EXPECT_EQ(words->find(""), empty);
+    EXPECT_EQ(words->find("word1"), StringInterner::npos);
+    EXPECT_EQ(words->find(nth_word(5000)), StringInterner::npos);
+
+    // Strings longer than an arena block get a block of their own.
+    std::string long_word(100000, 'x');
+    auto long_key = words->intern(long_word);
+    EXPECT_EQ(words->get(long_key), long_word);
+    EXPECT_EQ(words->get(keys[0]), nth_word(0));
+}
+
+TEST(MemoryReport, ShardedInternerMatchesAllocations)
+{
+    size_t before = live_bytes;
+    auto words = std::make_unique<ShardedStringInterner>();
+    for (int i = 0; i < 5000; i++)
+        words->intern(nth_word(i % 3000));
+    ASSERT_EQ(live_bytes - before, words->memory().total());
+}
+
+TEST(MemoryReport, BookAndWordMatchAllocations)
+{
+    std::vector<std::string> sentences;
+    for (int i = 0; i < 200; i++)
+        sentences.push_back(nth_word(i) + " " + nth_word(i + 1) + ", " + nth_word(i * 3) + ".");
+
+    // Warms up the per-thread scratch buffer of Sentence so that it does not show up below.
+    Sentence warm_up(sentences.back());
+
+    InternerMemory words_before = Word::memory();
+    size_t before = live_bytes;
+    auto book = std::make_unique<Book>();
+    for (auto &sentence : sentences)
+        book->add_Sentence(sentence);
+
+    size_t words_growth = Word::memory().total() - words_before.total();
+    ASSERT_EQ(live_bytes - before, book->memory().total() + words_growth);
+}
+
+TEST(MemoryReport, LoadedWordsAreReportedAsMapped)
+{
+    // The whole Word map is saved along with the book, so it is emptied first.
+    Word::clear();
+    Book book;
+    book.add_Sentence("alpha beta, gamma.");
+    book.save("memory_test.bin");
+    std::string text = book.get_text();
+
+    Word::clear();
+    Book loaded;
+    loaded.load("memory_test.bin");
+    std::remove("memory_test.bin");
+
+    ASSERT_EQ(text, loaded.get_text());
+    ASSERT_EQ(Word::memory().arena, 0u);
+    ASSERT_EQ(Word::memory().mapped, std::string("alphabeta,gamma.").size());
+}
+
+TEST(ShardedInterner, ConcurrentInternsAgree)
+{
+    // Threads intern overlapping words, so that lookups race with inserts into the same shards.
+    auto words = std::make_unique<ShardedStringInterner>();
+    std::vector<std::vector<ShardedStringInterner::key>> keys(4);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < keys.size(); t++)
+        workers.emplace_back([&, t]
+                             {
+            for (int i = 0; i < 20000; i++)
+                keys[t].push_back(words->intern(nth_word((i + int(t) * 1000) % 5000))); });
+    for (auto &worker : workers)
+        worker.join();
+
+    ASSERT_EQ(words->size(), 5000u);
+    for (size_t t = 0; t < keys.size(); t++)
+        for (int i = 0; i < 20000; i++)
+        {
+            std::string word = nth_word((i + int(t) * 1000) % 5000);
+            ASSERT_EQ(words->get(keys[t][i]), word);
+            ASSERT_EQ(words->find(word), keys[t][i]);
+        }
+}
+
+// Saves a book of one sentence and overwrites the byte `from_end` bytes before the end of the file with `value`.
+static void save_corrupt(const std::string &path, size_t from_end, char value)
+{
+    Word::clear();
+    Book book;
+    book.add_Sentence("alpha beta.");
+    book.save(path);
+
+    std::string bytes;
+    {
+        std::ifstream ifs(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(ifs), {});
+    }
+    bytes[bytes.size() - from_end] = value;
+    {
+        std::ofstream ofs(path, std::ios::binary);
+        ofs << bytes;
+    }
+}
+
+TEST(BookFile, CorruptKeysAreRejected)
+{
+    // The last byte is the key of the last word, 127 is far past the few words of its shard.
+    save_corrupt("corrupt_test.bin", 1, 0x7f);
+
+    // Both when the dictionary is adopted and when it is merged into the words already there.
+    Word::clear();
+    EXPECT_THROW(Book().load("corrupt_test.bin"), std::runtime_error);
+    Word::add_word("delta");
+    EXPECT_THROW(Book().load("corrupt_test.bin"), std::runtime_error);
+    std::remove("corrupt_test.bin");
+}
+
+TEST(BookFile, CorruptLengthsAreRejected)
+{
+    // The sentence length comes right before its 3 one-byte keys, 127 is more than is left in the file.
+    save_corrupt("corrupt_test.bin", 4, 0x7f);
+
+    Word::clear();
+    EXPECT_THROW(Book().load("corrupt_test.bin"), std::runtime_error);
+    std::remove("corrupt_test.bin");
+}
+
+// Sentences of a few hundred words, some of them frequent and some rare.
+static std::vector<std::string> corpus(int count, int offset = 0)
+{
+    std::vector<std::string> res;
+    for (int i = offset; i < offset + count; i++)
+        res.push_back(nth_word(i % 7) + " " + nth_word(i % 300) + ", " + nth_word(i * i % 500) + " " + nth_word(i % 7) + ".");
+    return res;
+}
+
+static void expect_same_statistics(const WordStatistics &a, const WordStatistics &b)
+{
+    EXPECT_EQ(a.frequencies, b.frequencies);
+    EXPECT_EQ(a.bigrams, b.bigrams);
+}
+
+TEST(BookCompaction, KeepsTextAndStatistics)
+{
+    Word::clear();
+    Book book;
+    book.add_Sentences(corpus(1000), 1);
+    std::string text = book.get_text();
+    WordStatistics statistics = book.statistics();
+
+    book.compact();
+    EXPECT_EQ(book.get_text(), text);
+    expect_same_statistics(book.statistics(), statistics);
+
+    // Sentences added afterwards come after the compacted ones, and a second compaction takes them all in.
+    Book reference;
+    reference.add_Sentences(corpus(1000), 1);
+    for (auto &sentence : corpus(200, 5000))
+    {
+        book.add_Sentence(sentence);
+        reference.add_Sentence(sentence);
+    }
+    EXPECT_EQ(book.get_text(), reference.get_text());
+    expect_same_statistics(book.statistics(4), reference.statistics());
+    book.compact();
+    EXPECT_EQ(book.get_text(), reference.get_text());
+    expect_same_statistics(book.statistics(), reference.statistics());
+}
+
+TEST(BookCompaction, SavedAndLoaded)
+{
+    Word::clear();
+    Book book;
+    book.add_Sentences(corpus(500), 1);
+    book.compact();
+    book.add_Sentence("alpha beta, gamma.");
+    book.save("compact_test.bin");
+    std::string text = book.get_text();
+
+    // Both when the dictionary is adopted and when it is merged into the words already there.
+    Word::clear();
+    Book adopted;
+    adopted.load("compact_test.bin");
+    EXPECT_EQ(adopted.get_text(), text);
+    Word::clear();
+    Word::add_word("delta");
+    Book merged;
+    merged.load("compact_test.bin");
+    EXPECT_EQ(merged.get_text(), text);
+    std::remove("compact_test.bin");
+}
+
+TEST(BookStatistics, ThreadsAgree)
+{
+    Word::clear();
+    Book book;
+    book.add_Sentences(corpus(1001), 1);
+    WordStatistics single = book.statistics(1);
+    // Every sentence of the corpus has four words, a comma and a period.
+    uint64_t words = 0;
+    for (auto count : single.frequencies)
+        words += count;
+    EXPECT_EQ(words, 6u * 1001);
+    for (unsigned threads : {2u, 4u, 3000u})
+        expect_same_statistics(book.statistics(threads), single);
+}
+
+TEST(BookStatistics, HandCountedCorpus)
+{
+    Word::clear();
+    Book book;
+    for (auto sentence : {"the cat sat", "the cat sat", "the cat ran", "the dog"})
+        book.add_Sentence(sentence);
+    WordStatistics statistics = book.statistics(4);
+
+    std::vector<std::pair<std::string, uint64_t>> words;
+    for (auto &[word_key, count] : statistics.top_words(3))
+        words.emplace_back(Word::get_word(word_key), count);
+    std::vector<std::pair<std::string, uint64_t>> expected_words{{"the", 4}, {"cat", 3}, {"sat", 2}};
+    EXPECT_EQ(words, expected_words);
+    EXPECT_EQ(statistics.top_words(10).size(), 5u);
+
+    std::vector<std::pair<std::string, uint64_t>> bigrams;
+    for (auto &[pair, count] : statistics.top_bigrams(2))
+        bigrams.emplace_back(Word::get_word(pair.first) + " " + Word::get_word(pair.second), count);
+    std::vector<std::pair<std::string, uint64_t>> expected_bigrams{{"the cat", 3}, {"cat sat", 2}};
+    EXPECT_EQ(bigrams, expected_bigrams);
+    // Bigrams do not cross sentences, there is no "sat the".
+    EXPECT_EQ(statistics.bigrams.size(), 4u);
+}
+
+// Writes the contents to the file as is, and reads it back into a book on the given number of threads.
+// Returns the text of the book along with its bigrams, which tell where the sentences were split as they do not cross sentences.
+static std::pair<std::string, WordStatistics> read_file(const std::string &path, const std::string &contents, unsigned threads)
+{
+    {
+        std::ofstream ofs(path, std::ios::binary);
+        ofs << contents;
+    }
+    Book book;
+    EXPECT_EQ(book.add_file(path, threads), contents.size());
+    std::remove(path.c_str());
+    return {book.get_text(), book.statistics()};
+}
+
+TEST(BookFile, LinesSplitAcrossThreads)
+{
+    Word::clear();
+    std::vector<std::string> lines = corpus(50);
+    Book expected;
+    std::string contents;
+    for (auto &line : lines)
+    {
+        expected.add_Sentence(line);
+        contents += line + "\n";
+    }
+    std::string text = expected.get_text();
+    WordStatistics statistics = expected.statistics();
+    auto expect_lines = [&](const std::string &contents, unsigned threads)
+    {
+        auto [read_text, read_statistics] = read_file("lines_test.txt", contents, threads);
+        EXPECT_EQ(read_text, text) << threads;
+        EXPECT_EQ(read_statistics.bigrams, statistics.bigrams) << threads;
+    };
+
+    for (unsigned threads : {1u, 3u, 8u, 200u})
+        expect_lines(contents, threads);
+
+    // Without a final newline, and with Windows line endings.
+    contents.pop_back();
+    for (unsigned threads : {1u, 200u})
+        expect_lines(contents, threads);
+    std::string crlf;
+    for (auto &line : lines)
+        crlf += line + "\r\n";
+    for (unsigned threads : {1u, 200u})
+        expect_lines(crlf, threads);
+}
+
+TEST(BookFile, EmptyFile)
+{
+    for (unsigned threads : {1u, 4u})
+        EXPECT_EQ(read_file("empty_test.txt", "", threads).first, "");
+}
+
+int main(int ac, char *av[])
+{
+    testing::InitGoogleTest(&ac, av);
+    return RUN_ALL_TESTS();
+}
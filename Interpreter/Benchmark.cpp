@@ -0,0 +1,236 @@
+/**
+ * @brief Benchmarks for the arithmetic Interpreter.
+ * Measures the parse throughput on expressions of increasing nesting depth, with a fresh arena per parse and with one arena cleared between parses,
+ * then compares evaluating random expressions of 10 to 10000 nodes by walking the tree against running their bytecode.
+ * It also compares the single-pass lexer against the one that built a string per token, on a few megabytes of rules.
+ * It then evaluates a handful of rules over and over, compiling them on every call against looking them up in an ExpressionCache.
+ * Finally it scores rows of inputs with a rule by rebuilding and parsing the rule per row, by running its bytecode per row and by running it over columns.
+ */
+
+#include "ExpressionCache.h"
+#include "Interpreter.h"
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Runs the function and returns the time it took in seconds.
+template <typename F>
+double time_seconds(F &&f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+/**
+ * @brief Lexer the Interpreter used before, kept as the baseline. Each token owns a string and integers go through an ostringstream.
+ */
+std::vector<std::pair<int, std::string>> legacy_lexer(std::string input)
+{
+    std::vector<std::pair<int, std::string>> res;
+    for (int i = 0; i < int(input.size()); i++)
+    {
+        switch (input[i])
+        {
+        case '+':
+        case '-':
+        case '*':
+        case '/':
+        case '(':
+        case ')':
+            res.push_back({input[i], std::string(1, input[i])});
+            break;
+        default:
+        {
+            std::ostringstream oss;
+            oss << input[i];
+            for (int j = i + 1; j < int(input.size()); j++)
+            {
+                if (isdigit(input[j]))
+                {
+                    oss << input[j];
+                    ++i;
+                }
+                else
+                {
+                    res.push_back({0, oss.str()});
+                    break;
+                }
+            }
+        }
+        }
+    }
+    return res;
+}
+
+// Expression nesting `depth` parenthesized levels, each with an addition, a multiplication and a division.
+std::string nested_expression(int depth)
+{
+    std::string res = "1";
+    for (int level = 1; level <= depth; level++)
+        res = "(" + res + "+" + std::to_string(level) + ")*2/2";
+    return res;
+}
+
+/**
+ * @brief Random expression of about `nodes` nodes, whose values stay far from overflowing.
+ * Multiplications and divisions only take a small literal on their right.
+ */
+std::string random_expression(size_t nodes, std::mt19937 &rng)
+{
+    if (nodes <= 1)
+        return std::to_string(rng() % 10);
+    switch (rng() % 6)
+    {
+    case 0:
+        return "(" + random_expression(nodes - 2, rng) + ")*" + std::to_string(1 + rng() % 2);
+    case 1:
+        return "(" + random_expression(nodes - 2, rng) + ")/" + std::to_string(1 + rng() % 3);
+    case 2:
+        return "-(" + random_expression(nodes - 1, rng) + ")";
+    default:
+    {
+        size_t left = 1 + rng() % (nodes - 1);
+        return "(" + random_expression(left, rng) + ")" + (rng() % 2 ? "+" : "-") + "(" + random_expression(nodes - 1 - left, rng) + ")";
+    }
+    }
+}
+
+int main()
+{
+    size_t checksum = 0;
+    std::cout << "Depth :: Tokens :: fresh arena ns/token :: reused arena ns/token\n";
+    for (int depth = 1; depth <= 256; depth *= 4)
+    {
+        std::string text = nested_expression(depth);
+        auto tokens = lexer(text);
+        // Parses about a million tokens in total at every depth.
+        size_t repeat = 1000000 / tokens.size() + 1;
+
+        double fresh_s = time_seconds([&]
+                                      {
+            for (size_t i = 0; i < repeat; i++)
+            {
+                Arena arena;
+                checksum += parse(tokens, text, arena) != nullptr;
+            } });
+
+        Arena arena;
+        double reused_s = time_seconds([&]
+                                       {
+            for (size_t i = 0; i < repeat; i++)
+            {
+                arena.clear();
+                checksum += parse(tokens, text, arena) != nullptr;
+            } });
+
+        double parsed = double(repeat) * tokens.size();
+        std::cout << depth << " :: " << tokens.size() << " :: " << fresh_s * 1e9 / parsed << " :: " << reused_s * 1e9 / parsed << "\n";
+    }
+
+    std::mt19937 rng(42);
+    std::cout << "Nodes :: Instructions :: tree walk ns/node :: bytecode ns/node\n";
+    for (size_t nodes = 10; nodes <= 10000; nodes *= 10)
+    {
+        Expression expression(random_expression(nodes, rng));
+        Program program = expression.compile();
+        // Evaluates about ten million nodes in total at every size.
+        size_t repeat = 10000000 / nodes;
+
+        double tree_s = time_seconds([&]
+                                     {
+            for (size_t i = 0; i < repeat; i++)
+                checksum += expression.eval(); });
+        double bytecode_s = time_seconds([&]
+                                         {
+            for (size_t i = 0; i < repeat; i++)
+                checksum += program.run(); });
+
+        double evaluated = double(repeat) * nodes;
+        std::cout << nodes << " :: " << program.size() << " :: " << tree_s * 1e9 / evaluated << " :: " << bytecode_s * 1e9 / evaluated << "\n";
+    }
+
+    std::string rules;
+    while (rules.size() < 8000000)
+        rules += random_expression(100, rng) + "\n";
+    size_t legacy_tokens = 0;
+    double legacy_lex_s = time_seconds([&]
+                                       { legacy_tokens = legacy_lexer(rules).size(); });
+    std::vector<Token> tokens;
+    double lex_s = time_seconds([&]
+                                { lexer(rules, tokens); });
+    // Lexing again into the grown vector allocates nothing.
+    double relex_s = time_seconds([&]
+                                  { lexer(rules, tokens); });
+    checksum += legacy_tokens + tokens.size();
+
+    std::cout << "Rules :: " << rules.size() / 1e6 << " MB, " << tokens.size() << " tokens\n";
+    std::cout << "String per token lexer :: " << rules.size() / legacy_lex_s / 1e6 << " MB/s\n";
+    std::cout << "Single-pass lexer      :: " << rules.size() / lex_s / 1e6 << " MB/s\n";
+    std::cout << "Single-pass lexer, reused tokens :: " << rules.size() / relex_s / 1e6 << " MB/s\n";
+
+    std::vector<std::string> sources;
+    for (int i = 0; i < 8; i++)
+        sources.push_back("(x + " + std::to_string(i) + ") * y - " + random_expression(20, rng));
+    const size_t calls = 200000;
+    double compiled_s = time_seconds([&]
+                                     {
+        for (size_t i = 0; i < calls; i++)
+            checksum += CompiledExpression(Expression(sources[i % sources.size()])).eval({int(i), 3}); });
+    ExpressionCache cache(16);
+    double cached_s = time_seconds([&]
+                                   {
+        for (size_t i = 0; i < calls; i++)
+            checksum += cache.get(sources[i % sources.size()])->eval({int(i), 3}); });
+
+    std::cout << "Compiled per call :: " << compiled_s * 1e9 / calls << " ns/call\n";
+    std::cout << "Cached            :: " << cached_s * 1e9 / calls << " ns/call, " << cache.hits() << " hits, " << cache.misses() << " misses\n";
+
+    const std::string rule = "(price * quantity - discount) * 3 / 2 + bonus - -(quantity * 2)";
+    const size_t rows = 1000000;
+    std::vector<int> price(rows), quantity(rows), discount(rows), bonus(rows), out(rows);
+    for (size_t r = 0; r < rows; r++)
+    {
+        price[r] = int(rng() % 1000);
+        quantity[r] = int(rng() % 10);
+        discount[r] = int(rng() % 100);
+        bonus[r] = int(rng() % 50);
+    }
+
+    // The way rules were scored before variables, on a tenth of the rows as it is much slower.
+    double rebuilt_s = time_seconds([&]
+                                    {
+        for (size_t r = 0; r < rows / 10; r++)
+        {
+            std::string text = "(" + std::to_string(price[r]) + " * " + std::to_string(quantity[r]) + " - " + std::to_string(discount[r]) + ") * 3 / 2 + " +
+                               std::to_string(bonus[r]) + " - -(" + std::to_string(quantity[r]) + " * 2)";
+            checksum += Expression(text).eval();
+        } }) * 10;
+
+    Expression expression(rule);
+    Program program = expression.compile();
+    double row_s = time_seconds([&]
+                                {
+        int values[4];
+        for (size_t r = 0; r < rows; r++)
+        {
+            values[0] = price[r], values[1] = quantity[r], values[2] = discount[r], values[3] = bonus[r];
+            checksum += program.run(values);
+        } });
+    double batch_s = time_seconds([&]
+                                  { program.run({price.data(), quantity.data(), discount.data(), bonus.data()}, rows, out.data()); });
+    for (int value : out)
+        checksum += value;
+
+    std::cout << "Rule :: " << rule << "\n";
+    std::cout << "Rebuilt and parsed per row :: " << rebuilt_s * 1e9 / rows << " ns/row\n";
+    std::cout << "Bytecode per row           :: " << row_s * 1e9 / rows << " ns/row\n";
+    std::cout << "Bytecode over columns      :: " << batch_s * 1e9 / rows << " ns/row\n";
+    std::cout << "Checksum :: " << checksum << "\n";
+    return 0;
+}
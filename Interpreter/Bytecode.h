@@ -0,0 +1,286 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * @brief An expression lowered to a flat array of instructions for a stack machine.
+ * Running it is a single loop over the array instead of a virtual call and a pointer chase per node.
+ * Operators whose right operand is an integer take it as an immediate, which saves a push and a pop.
+ * Variables are loaded by index, and a batch of rows can be run at once over columns of values.
+ */
+class Program
+{
+public:
+    // Both runs of binary operators follow the order of BinaryOperation::Type.
+    enum Op : uint8_t
+    {
+        push,
+        load,
+        negate,
+        add,
+        subtract,
+        multiply,
+        divide,
+        add_constant,
+        subtract_constant,
+        multiply_constant,
+        divide_constant
+    };
+
+    struct Instruction
+    {
+        Op op;
+        int operand;
+    };
+
+    explicit Program(size_t variables = 0) : variables(variables) {}
+
+    // Number of values a run takes.
+    size_t variable_count() const
+    {
+        return variables;
+    }
+
+    // Appends an instruction, keeping track of how deep the stack gets.
+    void emit(Op op, int operand = 0)
+    {
+        if (op == push || op == load)
+            max_depth = std::max(max_depth, ++depth);
+        else if (op >= add && op <= divide)
+            depth--;
+        code.push_back({op, operand});
+    }
+
+    /**
+     * @brief Applies a binary operator, in its plain or constant form, to two values.
+     * Throws `std::runtime_error` on a division by zero or a result out of the range of int, such as INT_MIN / -1, instead of crashing or wrapping around.
+     */
+    static int apply(Op op, int lhs, int rhs)
+    {
+        // Wide enough for the result of any operator on two ints.
+        int64_t res;
+        switch (op)
+        {
+        case add:
+        case add_constant:
+            res = int64_t(lhs) + rhs;
+            break;
+        case subtract:
+        case subtract_constant:
+            res = int64_t(lhs) - rhs;
+            break;
+        case multiply:
+        case multiply_constant:
+            res = int64_t(lhs) * rhs;
+            break;
+        case divide:
+        case divide_constant:
+            if (rhs == 0)
+                throw std::runtime_error("Division by zero.");
+            res = int64_t(lhs) / rhs;
+            break;
+        default:
+            throw std::logic_error("Not a binary operator.");
+        }
+        if (res < INT32_MIN || res > INT32_MAX)
+            throw std::runtime_error("Integer overflow.");
+        return static_cast<int>(res);
+    }
+
+    /**
+     * @brief Runs the program with one value per variable and returns the value left on the stack.
+     * Throws `std::runtime_error` on a division by zero, an overflow or if values are missing for a program with variables.
+     */
+    int run(const int *values = nullptr) const
+    {
+        if (!values && variables)
+            throw std::runtime_error("Expected " + std::to_string(variables) + " values, got none.");
+
+        // Most expressions fit the stack kept on the machine's own.
+        int local[64];
+        std::vector<int> heap;
+        int *stack = local;
+        if (max_depth > 64)
+        {
+            heap.resize(max_depth);
+            stack = heap.data();
+        }
+
+        // Index of the top of the stack.
+        size_t top = 0;
+        for (const Instruction &instruction : code)
+        {
+            switch (instruction.op)
+            {
+            case push:
+                stack[top++] = instruction.operand;
+                break;
+            case load:
+                stack[top++] = values[instruction.operand];
+                break;
+            case negate:
+                stack[top - 1] = apply(subtract, 0, stack[top - 1]);
+                break;
+            case add:
+                top--;
+                stack[top - 1] = apply(add, stack[top - 1], stack[top]);
+                break;
+            case subtract:
+                top--;
+                stack[top - 1] = apply(subtract, stack[top - 1], stack[top]);
+                break;
+            case multiply:
+                top--;
+                stack[top - 1] = apply(multiply, stack[top - 1], stack[top]);
+                break;
+            case divide:
+                top--;
+                stack[top - 1] = apply(divide, stack[top - 1], stack[top]);
+                break;
+            case add_constant:
+                stack[top - 1] = apply(add_constant, stack[top - 1], instruction.operand);
+                break;
+            case subtract_constant:
+                stack[top - 1] = apply(subtract_constant, stack[top - 1], instruction.operand);
+                break;
+            case multiply_constant:
+                stack[top - 1] = apply(multiply_constant, stack[top - 1], instruction.operand);
+                break;
+            case divide_constant:
+                stack[top - 1] = apply(divide_constant, stack[top - 1], instruction.operand);
+                break;
+            }
+        }
+        return top ? stack[top - 1] : 0;
+    }
+
+    /**
+     * @brief Runs the program over `rows` rows, the value of variable i in row r being `columns[i][r]`, and writes the value of row r to `out[r]`.
+     * Every instruction is applied to a block of rows before the next one, as a plain loop over arrays the compiler vectorizes.
+     * Throws `std::runtime_error` on a division by zero or an overflow in any row, or if there is not one column per variable.
+     */
+    void run(const std::vector<const int *> &columns, size_t rows, int *out) const
+    {
+        if (columns.size() != variables)
+            throw std::runtime_error("Expected " + std::to_string(variables) + " columns, got " + std::to_string(columns.size()) + ".");
+
+        // Every stack entry holds a whole block of rows.
+        std::vector<int> stack(std::max<size_t>(max_depth, 1) * block);
+        for (size_t first = 0; first < rows; first += block)
+        {
+            size_t count = std::min(block, rows - first);
+            size_t top = 0;
+            for (const Instruction &instruction : code)
+            {
+                // Top entry of the stack and the free one above it, binary operators move them one entry down.
+                int *a = stack.data() + (top ? top - 1 : 0) * block;
+                int *b = stack.data() + top * block;
+                switch (instruction.op)
+                {
+                case push:
+                    std::fill(b, b + count, instruction.operand);
+                    top++;
+                    break;
+                case load:
+                    std::memcpy(b, columns[instruction.operand] + first, count * sizeof(int));
+                    top++;
+                    break;
+                case negate:
+                    if (std::find(a, a + count, INT32_MIN) != a + count)
+                        throw std::runtime_error("Integer overflow.");
+                    for (size_t i = 0; i < count; i++)
+                        a[i] = -a[i];
+                    break;
+                case add:
+                    b = a, a -= block, top--;
+                    store_checked(a, count, [&](size_t i)
+                                  { return int64_t(a[i]) + b[i]; });
+                    break;
+                case subtract:
+                    b = a, a -= block, top--;
+                    store_checked(a, count, [&](size_t i)
+                                  { return int64_t(a[i]) - b[i]; });
+                    break;
+                case multiply:
+                    b = a, a -= block, top--;
+                    store_checked(a, count, [&](size_t i)
+                                  { return int64_t(a[i]) * b[i]; });
+                    break;
+                case divide:
+                {
+                    b = a, a -= block, top--;
+                    bool zero = false, overflow = false;
+                    for (size_t i = 0; i < count; i++)
+                    {
+                        zero |= b[i] == 0;
+                        overflow |= (b[i] == -1) & (a[i] == INT32_MIN);
+                    }
+                    if (zero)
+                        throw std::runtime_error("Division by zero.");
+                    if (overflow)
+                        throw std::runtime_error("Integer overflow.");
+                    for (size_t i = 0; i < count; i++)
+                        a[i] /= b[i];
+                    break;
+                }
+                case add_constant:
+                    store_checked(a, count, [&](size_t i)
+                                  { return int64_t(a[i]) + instruction.operand; });
+                    break;
+                case subtract_constant:
+                    store_checked(a, count, [&](size_t i)
+                                  { return int64_t(a[i]) - instruction.operand; });
+                    break;
+                case multiply_constant:
+                    store_checked(a, count, [&](size_t i)
+                                  { return int64_t(a[i]) * instruction.operand; });
+                    break;
+                case divide_constant:
+                    if (instruction.operand == 0)
+                        throw std::runtime_error("Division by zero.");
+                    if (instruction.operand == -1 && std::find(a, a + count, INT32_MIN) != a + count)
+                        throw std::runtime_error("Integer overflow.");
+                    for (size_t i = 0; i < count; i++)
+                        a[i] /= instruction.operand;
+                    break;
+                }
+            }
+            std::memcpy(out + first, stack.data(), count * sizeof(int));
+        }
+    }
+
+    // Number of instructions.
+    size_t size() const
+    {
+        return code.size();
+    }
+
+private:
+    // Rows run together by the batch run, small enough for the stack to stay in cache.
+    static constexpr size_t block = 256;
+
+    // Writes `value(i)`, computed in 64 bits, to `out[i]` for every row, and throws once for the whole block if any is out of the range of int.
+    template <typename Value>
+    static void store_checked(int *out, size_t count, Value value)
+    {
+        bool overflow = false;
+        for (size_t i = 0; i < count; i++)
+        {
+            int64_t res = value(i);
+            overflow |= (res < INT32_MIN) | (res > INT32_MAX);
+            out[i] = static_cast<int>(res);
+        }
+        if (overflow)
+            throw std::runtime_error("Integer overflow.");
+    }
+
+    std::vector<Instruction> code;
+    size_t variables{0};
+    size_t depth{0};
+    size_t max_depth{0};
+};
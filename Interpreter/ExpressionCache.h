@@ -0,0 +1,171 @@
+#pragma once
+#include "Interpreter.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief An expression compiled to bytecode along with the names of its variables, all that is needed to evaluate it.
+ */
+struct CompiledExpression
+{
+    std::vector<std::string> variables;
+    Program program;
+
+    explicit CompiledExpression(const Expression &expression) : variables(expression.variables()), program(expression.compile()) {}
+
+    /**
+     * @brief Evaluates the expression with one value per variable. Throws `std::runtime_error` if the count does not match.
+     */
+    int eval(const std::vector<int> &values = {}) const
+    {
+        if (values.size() != variables.size())
+            throw std::runtime_error("Expected " + std::to_string(variables.size()) + " values, got " + std::to_string(values.size()) + ".");
+        return program.run(values.data());
+    }
+};
+
+/**
+ * @brief Cache of compiled expressions keyed by their source text, so that an expression seen before is neither lexed nor parsed again.
+ * Lookups only take a shared lock and hash a view of the source, nothing is copied nor allocated on a hit.
+ * When full, the least recently used entry is evicted as approximated by the CLOCK algorithm:
+ * a hit sets the entry's referenced bit, and eviction sweeps the entries, sparing and clearing the referenced ones.
+ * Unlike a list kept in exact LRU order, hits never need to write shared state under an exclusive lock.
+ */
+class ExpressionCache
+{
+    struct Entry
+    {
+        std::string source;
+        std::shared_ptr<const CompiledExpression> compiled;
+        std::atomic<bool> referenced{false};
+    };
+
+    // Counter spread over cache lines, so that threads counting at the same time do not contend.
+    class Counter
+    {
+        struct alignas(64) Stripe
+        {
+            std::atomic<size_t> count{0};
+        };
+        Stripe stripes[16];
+
+    public:
+        void increment()
+        {
+            thread_local size_t stripe = std::hash<std::thread::id>{}(std::this_thread::get_id()) % 16;
+            stripes[stripe].count.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        size_t load() const
+        {
+            size_t res = 0;
+            for (auto &stripe : stripes)
+                res += stripe.count.load(std::memory_order_relaxed);
+            return res;
+        }
+    };
+
+    const size_t capacity;
+    mutable std::shared_mutex mutex;
+    std::vector<std::unique_ptr<Entry>> entries;
+    // Keys are views of the sources held by the entries.
+    std::unordered_map<std::string_view, size_t> index;
+    // Next entry the eviction sweep looks at.
+    size_t hand{0};
+    Counter hit_count;
+    Counter miss_count;
+
+    // Picks the entry to replace. Expects the exclusive lock to be held and the cache to be full.
+    size_t evict()
+    {
+        for (;; hand = (hand + 1) % entries.size())
+            if (!entries[hand]->referenced.exchange(false, std::memory_order_relaxed))
+                return hand;
+    }
+
+public:
+    explicit ExpressionCache(size_t capacity) : capacity(std::max<size_t>(capacity, 1))
+    {
+        entries.reserve(this->capacity);
+        index.reserve(this->capacity);
+    }
+
+    /**
+     * @brief Returns the compiled expression, compiling and caching it on a miss.
+     * Throws `std::runtime_error` for a malformed expression, which is not cached.
+     */
+    std::shared_ptr<const CompiledExpression> get(std::string_view source)
+    {
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            auto it = index.find(source);
+            if (it != index.end())
+            {
+                Entry &entry = *entries[it->second];
+                // Only written when not set already, so that hot entries are not written on every hit.
+                if (!entry.referenced.load(std::memory_order_relaxed))
+                    entry.referenced.store(true, std::memory_order_relaxed);
+                hit_count.increment();
+                return entry.compiled;
+            }
+        }
+
+        miss_count.increment();
+        // Compiled outside the lock so that hits go on meanwhile.
+        auto compiled = std::make_shared<const CompiledExpression>(Expression(source));
+
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        auto it = index.find(source);
+        if (it != index.end())
+            return entries[it->second]->compiled;
+
+        size_t slot;
+        if (entries.size() < capacity)
+        {
+            slot = entries.size();
+            entries.push_back(std::make_unique<Entry>());
+        }
+        else
+        {
+            slot = evict();
+            index.erase(entries[slot]->source);
+            hand = (slot + 1) % entries.size();
+        }
+        Entry &entry = *entries[slot];
+        entry.source.assign(source);
+        entry.compiled = compiled;
+        entry.referenced.store(false, std::memory_order_relaxed);
+        index.emplace(entry.source, slot);
+        return compiled;
+    }
+
+    // Number of lookups that found the expression cached.
+    size_t hits() const
+    {
+        return hit_count.load();
+    }
+
+    // Number of lookups that had to compile the expression.
+    size_t misses() const
+    {
+        return miss_count.load();
+    }
+
+    // Number of cached expressions.
+    size_t size() const
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return entries.size();
+    }
+};
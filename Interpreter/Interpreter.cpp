@@ -4,218 +4,227 @@
  * @brief Interpreter Pattern can be exemplified by a Arithmetic Expression Interpreter that takes expressions as string input and produces the results/.
  */
 
+#include "ExpressionCache.h"
+#include "Interpreter.h"
+#include <gtest/gtest.h>
 #include <iostream>
-#include <memory>
-#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
 /**
- * @brief Keeps track of individual token in the text.
- * 
+ * Operators follow the usual precedence and associativity, at any depth of parentheses.
  */
-struct Token
+TEST(ParserTests, PrecedenceAndNesting)
 {
-    // Denotes all the allowed tokens in the text.
-    enum TokenType
-    {
-        integer,
-        plus,
-        minus,
-        lparen,
-        rparen
-    } type;
-
-    std::string token;
-
-    Token(TokenType type, std::string token) : type(type), token(token) {}
-
-    friend std::ostream &operator<<(std::ostream &oss, Token &t)
-    {
-        return oss << "'" << t.token << "'";
-    }
-};
+    EXPECT_EQ(Expression("(13-10)-(12-8)").eval(), -1);
+    EXPECT_EQ(Expression("1+2*3").eval(), 7);
+    EXPECT_EQ(Expression("10-4-3").eval(), 3);
+    EXPECT_EQ(Expression("100/10/5").eval(), 2);
+    EXPECT_EQ(Expression("((1+2)*(3+4))-((5))").eval(), 16);
+    EXPECT_EQ(Expression(" 2 * ( 3 + 4 ) ").eval(), 14);
+    EXPECT_EQ(Expression("42").eval(), 42);
+}
 
 /**
- * @brief Travereses the Text and divides it into the required Tokens
+ * A unary minus applies to the operand right after it.
  */
-std::vector<Token> lexer(std::string input)
+TEST(ParserTests, UnaryMinus)
 {
-    std::vector<Token> res;
-    for (int i = 0; i < input.size(); i++)
-    {
-        switch (input[i])
-        {
-        case '+':
-        {
-            res.push_back(Token(Token::plus, "+"));
-            break;
-        }
-        case '-':
-        {
-            res.push_back(Token(Token::minus, "-"));
-            break;
-        }
-        case '(':
-        {
-            res.push_back(Token(Token::lparen, "("));
-            break;
-        }
-        case ')':
-        {
-            res.push_back(Token(Token::rparen, ")"));
-            break;
-        }
-        default:
-        {
-            std::ostringstream oss;
-            oss << input[i];
-            for (int j = i + 1; j < input.size(); j++)
-            {
-                if (isdigit(input[j]))
-                {
-                    oss << input[j];
-                    ++i;
-                }
-                else
-                {
-                    res.push_back(Token{Token::integer, oss.str()});
-                    break;
-                }
-            }
-        }
-        }
-    }
-    return res;
+    EXPECT_EQ(Expression("-3").eval(), -3);
+    EXPECT_EQ(Expression("-2*3").eval(), -6);
+    EXPECT_EQ(Expression("4--2").eval(), 6);
+    EXPECT_EQ(Expression("-(1+2)*-3").eval(), 9);
 }
 
 /**
- * @brief Abstraction for OOP-based notation for all the tokens.
- * Provides evaluation funtionality to all the tokens.
+ * Malformed expressions are reported rather than silently evaluated.
  */
-struct Element
+TEST(ParserTests, Errors)
 {
-    virtual int eval() = 0;
-};
+    for (auto text : {"", "1+", "(1+2", "1+2)", "1 2", "*3", "()", "1+$", "a b", "99999999999"})
+        EXPECT_THROW(Expression{text}, std::runtime_error) << text;
+    EXPECT_THROW(Expression("1/(2-2)").eval(), std::runtime_error);
+    // The outermost expression is a level of its own, so 999 parentheses are as deep as it goes.
+    EXPECT_EQ(Expression(std::string(999, '(') + "1" + std::string(999, ')')).eval(), 1);
+    EXPECT_THROW(Expression(std::string(1000, '(') + "1" + std::string(1000, ')')), std::runtime_error);
+    EXPECT_THROW(Expression(std::string(20000, '(') + "1" + std::string(20000, ')')), std::runtime_error);
+    for (auto text : {"(-2147483647-1)/(0-1)", "2147483647+1", "-2147483647-2", "65536*65536", "-(-2147483647-1)"})
+        EXPECT_THROW(Expression(text).eval(), std::runtime_error) << text;
+
+    // Long chains of operators make trees as deep as nesting does.
+    std::string chain = "1";
+    for (int i = 0; i < 200000; i++)
+        chain += "+1";
+    EXPECT_THROW(Expression{chain}, std::runtime_error);
+    chain.resize(2 * 1000 - 1);
+    EXPECT_EQ(Expression(chain).eval(), 1000);
+}
 
-// Stores the integers present in the text as a object.
-struct Integer : Element
+/**
+ * The bytecode gives the same values as walking the tree, immediates and folded negations included.
+ */
+TEST(BytecodeTests, MatchesTreeWalk)
 {
-    int value{0};
-
-    Integer(int val) : value(val) {}
-
-    int eval() override
+    for (auto text : {"(13-10)-(12-8)", "1+2*3", "10-4-3", "100/10/5", "-(1+2)*-3", "-7", "2*(3+4)/-(1+1)", "((((1))))-((2)-(3-(4-5)))"})
     {
-        return value;
+        Expression expression(text);
+        EXPECT_EQ(expression.compile().run(), expression.eval()) << text;
     }
-};
+    EXPECT_EQ(Expression("1+2*3").compile().size(), 4u);
+
+    std::string deep = "1";
+    for (int i = 0; i < 200; i++)
+        deep = "2-(" + deep + ")";
+    EXPECT_EQ(Expression(deep).compile().run(), Expression(deep).eval());
+
+    EXPECT_THROW(Expression("1/0").compile().run(), std::runtime_error);
+    EXPECT_THROW(Expression("1/(2-2)").compile().run(), std::runtime_error);
+    for (auto text : {"(-2147483647-1)/(0-1)", "(-2147483647-1)/-1", "2147483647+1", "-2147483647-2", "65536*65536", "-(-2147483647-1)"})
+        EXPECT_THROW(Expression(text).compile().run(), std::runtime_error) << text;
+}
 
 /**
- * @brief Stores all the binary operator present in the text as an object.
+ * Variables are numbered by first use and evaluate the same through the tree, the bytecode and the batch run.
  */
-struct BinaryOperation : Element
+TEST(VariableTests, SingleAndBatch)
 {
-    Element *lhs, *rhs;
-    enum Type
+    Expression expression("price * quantity - discount / 2 + -price");
+    EXPECT_EQ(expression.variables(), (std::vector<std::string>{"price", "quantity", "discount"}));
+    EXPECT_EQ(expression.eval({10, 3, 4}), 18);
+    Program program = expression.compile();
+    std::vector<int> values = {10, 3, 4};
+    EXPECT_EQ(program.run(values.data()), 18);
+
+    // More rows than a block, so that the last block is partial.
+    const size_t rows = 1000;
+    std::vector<int> price(rows), quantity(rows), discount(rows), out(rows);
+    for (size_t r = 0; r < rows; r++)
     {
-        addition,
-        subtraction
-    } type;
-
-    BinaryOperation() {}
-
-    int eval() override
+        price[r] = int(r);
+        quantity[r] = int(r % 7);
+        discount[r] = int(r % 5) - 2;
+    }
+    program.run({price.data(), quantity.data(), discount.data()}, rows, out.data());
+    for (size_t r = 0; r < rows; r++)
+        ASSERT_EQ(out[r], expression.eval({price[r], quantity[r], discount[r]})) << r;
+
+    EXPECT_THROW(expression.eval({1, 2}), std::runtime_error);
+    EXPECT_THROW(program.run({price.data()}, rows, out.data()), std::runtime_error);
+    EXPECT_THROW(Expression("x / y").compile().run({price.data(), discount.data()}, rows, out.data()), std::runtime_error);
+    EXPECT_THROW(Expression("x + 1").compile().run(), std::runtime_error);
+
+    // Overflows in any row of the batch are reported, whichever operator makes them.
+    std::vector<int> smallest(rows, INT32_MIN), minus_one(rows, -1);
+    for (auto text : {"x / y", "x / -1", "-x", "x + y", "x - 1", "x * y", "x * 2"})
     {
-        switch (type)
-        {
-        case addition:
-            return lhs->eval() + rhs->eval();
-        case subtraction:
-            return lhs->eval() - rhs->eval();
-        }
-
-        return 0;
+        Program overflowing = Expression(text).compile();
+        std::vector<const int *> columns = {smallest.data(), minus_one.data()};
+        columns.resize(overflowing.variable_count());
+        EXPECT_THROW(overflowing.run(columns, rows, out.data()), std::runtime_error) << text;
     }
-};
+    // The parser only takes variables when given a table for them.
+    Arena arena;
+    EXPECT_THROW(parse(lexer("1 + x"), "1 + x", arena), std::runtime_error);
+}
 
 /**
- * @brief Parses all the tokens into their OOP-counterparts that can be evaulated.
- * !@warning Cannot parse Nested Parenthesis and unary operations e.g. negative numbers.
+ * Tokens cover the whole input, including an integer right at its end, and whitespace makes no token.
  */
-Element *parse(std::vector<Token> &tokens)
+TEST(LexerTests, CompactTokens)
 {
-    auto res = new BinaryOperation();
-    auto have_lhs{false};
-    for (int i = 0; i < tokens.size(); i++)
-    {
-        auto &token = tokens[i];
-        switch (token.type)
-        {
-        case Token::integer:
-        {
-            int val = std::stoi(token.token);
-            // std::cout << val << " ";
-            auto integer = new Integer{val};
-            if (!have_lhs)
-            {
-                res->lhs = integer;
-                have_lhs = true;
-            }
-            else
-            {
-                res->rhs = integer;
-            }
-            break;
-        }
-        case Token::plus:
-        {
-            res->type = BinaryOperation::addition;
-            break;
-        }
-        case Token::minus:
-        {
-            res->type = BinaryOperation::subtraction;
-            break;
-        }
-        case Token::lparen:
-        {
-            int j = i;
-            for (; j < tokens.size(); j++)
-                if (tokens[j].type == Token::rparen)
-                    break;
-
-            std::vector<Token> sub_expr(&tokens[i + 1], &tokens[j]);
-            auto sub_expr_parsed = parse(sub_expr);
-
-            if (have_lhs)
-            {
-                res->rhs = sub_expr_parsed;
-            }
-            else
-            {
-                res->lhs = sub_expr_parsed;
-                have_lhs = true;
-            }
-            i = j;
-        }
-        }
-    }
-    
-    return res;
+    std::string_view input = " 12+\tprice_2 *(3)\n-45";
+    auto tokens = lexer(input);
+    std::vector<std::string_view> texts;
+    for (auto &token : tokens)
+        texts.push_back(token.text(input));
+    EXPECT_EQ(texts, (std::vector<std::string_view>{"12", "+", "price_2", "*", "(", "3", ")", "-", "45"}));
+    EXPECT_EQ(tokens[0].type, Token::integer);
+    EXPECT_EQ(tokens[0].value, 12);
+    EXPECT_EQ(tokens[2].type, Token::identifier);
+    EXPECT_EQ(tokens.back().type, Token::integer);
+    EXPECT_EQ(tokens.back().value, 45);
+    EXPECT_EQ(tokens.back().offset, input.size() - 2);
+
+    // Lexing into the same vector again replaces its tokens.
+    lexer("7", tokens);
+    ASSERT_EQ(tokens.size(), 1u);
+    EXPECT_EQ(tokens[0].value, 7);
+    lexer(" \t\n", tokens);
+    EXPECT_TRUE(tokens.empty());
+
+    EXPECT_EQ(lexer("2147483647")[0].value, 2147483647);
+    EXPECT_THROW(lexer("2147483648"), std::runtime_error);
+    EXPECT_THROW(lexer("1 # 2"), std::runtime_error);
+}
+
+/**
+ * Hits return the compiled expression without compiling again, and the entry not used since the last sweep is the one evicted.
+ */
+TEST(ExpressionCacheTests, HitsMissesAndEviction)
+{
+    ExpressionCache cache(2);
+    auto a = cache.get("x + 1");
+    EXPECT_EQ(a->eval({41}), 42);
+    cache.get("2 * 3");
+    EXPECT_EQ(cache.get(std::string("x + 1")), a);
+    EXPECT_EQ(cache.hits(), 1u);
+    EXPECT_EQ(cache.misses(), 2u);
+
+    // "x + 1" was used since it was added, so "2 * 3" goes.
+    EXPECT_EQ(cache.get("7")->eval(), 7);
+    EXPECT_EQ(cache.size(), 2u);
+    EXPECT_EQ(cache.get("x + 1"), a);
+    EXPECT_EQ(cache.misses(), 3u);
+    cache.get("2 * 3");
+    EXPECT_EQ(cache.misses(), 4u);
+
+    // Evicted expressions stay usable by whoever holds them.
+    EXPECT_EQ(a->eval({1}), 2);
+    EXPECT_THROW(cache.get("1 +"), std::runtime_error);
+    EXPECT_THROW(a->eval(), std::runtime_error);
 }
 
+/**
+ * Threads looking expressions up at once all get correct results, and every lookup is counted once.
+ */
+TEST(ExpressionCacheTests, ConcurrentLookups)
+{
+    ExpressionCache cache(3);
+    const std::vector<std::string> sources = {"x * 2", "x - 1", "-x", "x / 2 + 1"};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; t++)
+        threads.emplace_back([&, t]
+                             {
+            for (int i = 0; i < 2000; i++)
+            {
+                size_t which = (t + i) % sources.size();
+                int value = cache.get(sources[which])->eval({i});
+                int expected = which == 0 ? i * 2 : which == 1 ? i - 1 : which == 2 ? -i : i / 2 + 1;
+                ASSERT_EQ(value, expected);
+            } });
+    for (auto &thread : threads)
+        thread.join();
+
+    EXPECT_EQ(cache.hits() + cache.misses(), 8u * 2000);
+    EXPECT_LE(cache.size(), 3u);
+}
 
-int main()
+int main(int argc, char *argv[])
 {
     std::string input("(13-10)-(12-8)");
     auto tokens = lexer(input);
 
-    for (auto token : tokens)
-        std::cout << token << " ";
+    for (auto &token : tokens)
+        std::cout << "'" << token.text(input) << "' ";
 
-    auto parsed = parse(tokens);
+    Arena arena;
+    auto parsed = parse(tokens, input, arena);
 
-    std::cout <<"\n" << input << "=" << parsed->eval();
-    return 0;
-}
\ No newline at end of file
+    std::cout << "\n"
+              << input << "=" << parsed->eval() << "\n";
+
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
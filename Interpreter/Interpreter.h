@@ -0,0 +1,506 @@
+#pragma once
+#include "Bytecode.h"
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Keeps track of individual token in the text.
+ * Tokens do not own any text, they refer to their place in the source, and integers carry their value parsed while lexing.
+ */
+struct Token
+{
+    // Denotes all the allowed tokens in the text.
+    enum TokenType : uint8_t
+    {
+        integer,
+        identifier,
+        plus,
+        minus,
+        times,
+        divide,
+        lparen,
+        rparen
+    } type;
+
+    uint32_t offset;
+    uint32_t length;
+    // Value of an integer token, 0 for the others.
+    int value;
+
+    // Text of the token in the source it was lexed from.
+    std::string_view text(std::string_view source) const
+    {
+        return source.substr(offset, length);
+    }
+};
+
+/**
+ * @brief Travereses the Text and divides it into the required Tokens, replacing what `tokens` held.
+ * Runs in a single pass, and reusing the same vector makes lexing allocation-free once it has grown to size.
+ * Whitespace separates tokens, any other character that is not part of a token is an error.
+ * Identifiers start with a letter or '_' and go on with letters, digits and '_'.
+ */
+inline void lexer(std::string_view input, std::vector<Token> &tokens)
+{
+    if (input.size() > UINT32_MAX)
+        throw std::runtime_error("Input too large to lex.");
+    auto is_digit = [](char c)
+    { return c >= '0' && c <= '9'; };
+    auto is_word = [&](char c)
+    { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || is_digit(c); };
+
+    tokens.clear();
+    const char *begin = input.data();
+    const char *end = begin + input.size();
+    for (const char *pos = begin; pos < end;)
+    {
+        const char *start = pos;
+        Token::TokenType type;
+        int value = 0;
+        switch (*pos)
+        {
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r':
+        case '\f':
+        case '\v':
+            pos++;
+            continue;
+        case '+':
+            type = Token::plus, pos++;
+            break;
+        case '-':
+            type = Token::minus, pos++;
+            break;
+        case '*':
+            type = Token::times, pos++;
+            break;
+        case '/':
+            type = Token::divide, pos++;
+            break;
+        case '(':
+            type = Token::lparen, pos++;
+            break;
+        case ')':
+            type = Token::rparen, pos++;
+            break;
+        default:
+            if (is_digit(*pos))
+            {
+                type = Token::integer;
+                auto [parsed, error] = std::from_chars(pos, end, value);
+                while (parsed < end && is_digit(*parsed))
+                    parsed++;
+                if (error == std::errc::result_out_of_range)
+                    throw std::runtime_error("Integer out of range at " + std::to_string(start - begin) + ".");
+                pos = parsed;
+            }
+            else if (is_word(*pos))
+            {
+                type = Token::identifier;
+                while (pos < end && is_word(*pos))
+                    pos++;
+            }
+            else
+                throw std::runtime_error("Unexpected character '" + std::string(1, *pos) + "' at " + std::to_string(start - begin) + ".");
+        }
+        tokens.push_back({type, static_cast<uint32_t>(start - begin), static_cast<uint32_t>(pos - start), value});
+    }
+}
+
+// Same as above into a new vector.
+inline std::vector<Token> lexer(std::string_view input)
+{
+    std::vector<Token> res;
+    lexer(input, res);
+    return res;
+}
+
+/**
+ * @brief Bump allocator that hands out the nodes of an expression and frees them all at once.
+ * Memory comes in blocks that double in size, so a parse makes a handful of allocations whatever the number of nodes.
+ * Only trivially destructible objects can be made, as nothing is destroyed but the blocks themselves.
+ */
+class Arena
+{
+    static constexpr size_t min_block_size = 1024;
+    static constexpr size_t max_block_size = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    size_t block_size{0};
+    size_t block_used{0};
+    size_t arena_bytes{0};
+
+    void *allocate(size_t size, size_t align)
+    {
+        size_t start = (block_used + align - 1) & ~(align - 1);
+        if (blocks.empty() || start + size > block_size)
+        {
+            block_size = std::max(std::clamp(arena_bytes, min_block_size, max_block_size), size);
+            blocks.push_back(std::make_unique<char[]>(block_size));
+            arena_bytes += block_size;
+            start = 0;
+        }
+        block_used = start + size;
+        return blocks.back().get() + start;
+    }
+
+public:
+    Arena() = default;
+    Arena(Arena &&) = default;
+    Arena &operator=(Arena &&) = default;
+
+    template <typename T, typename... Args>
+    T *make(Args &&...args)
+    {
+        static_assert(std::is_trivially_destructible_v<T>, "Arena objects are never destroyed.");
+        static_assert(alignof(T) <= alignof(std::max_align_t), "Arena blocks are only aligned for fundamental types.");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // Frees everything made so far, keeping the last block to be reused.
+    void clear()
+    {
+        if (blocks.size() > 1)
+            blocks.erase(blocks.begin(), blocks.end() - 1);
+        arena_bytes = block_size;
+        block_used = 0;
+    }
+
+    // Bytes held by the blocks.
+    size_t memory() const
+    {
+        return arena_bytes;
+    }
+};
+
+/**
+ * @brief Abstraction for OOP-based notation for all the tokens.
+ * Provides evaluation funtionality to all the tokens, and lowering to bytecode for expressions evaluated many times.
+ */
+struct Element
+{
+    // Evaluates the element with the values of the variables, indexed as they were numbered by the parser.
+    virtual int eval(const int *variables) = 0;
+
+    int eval()
+    {
+        return eval(nullptr);
+    }
+
+    // Appends the instructions computing the element, which leave its value on the stack.
+    virtual void compile(Program &program) const = 0;
+};
+
+// Stores the integers present in the text as a object.
+struct Integer : Element
+{
+    int value{0};
+
+    Integer(int val) : value(val) {}
+
+    int eval(const int *) override
+    {
+        return value;
+    }
+
+    void compile(Program &program) const override
+    {
+        program.emit(Program::push, value);
+    }
+};
+
+/**
+ * @brief Stores a named variable, by the index of its value.
+ */
+struct Variable : Element
+{
+    size_t index;
+
+    explicit Variable(size_t index) : index(index) {}
+
+    int eval(const int *variables) override
+    {
+        return variables[index];
+    }
+
+    void compile(Program &program) const override
+    {
+        program.emit(Program::load, static_cast<int>(index));
+    }
+};
+
+/**
+ * @brief Stores the unary minus applied to an operand.
+ */
+struct Negation : Element
+{
+    Element *operand;
+
+    explicit Negation(Element *operand) : operand(operand) {}
+
+    int eval(const int *variables) override
+    {
+        return Program::apply(Program::subtract, 0, operand->eval(variables));
+    }
+
+    void compile(Program &program) const override
+    {
+        // A negative literal is folded into a single push.
+        if (auto constant = dynamic_cast<const Integer *>(operand))
+            return program.emit(Program::push, -constant->value);
+        operand->compile(program);
+        program.emit(Program::negate);
+    }
+};
+
+/**
+ * @brief Stores all the binary operator present in the text as an object.
+ */
+struct BinaryOperation : Element
+{
+    Element *lhs, *rhs;
+    enum Type
+    {
+        addition,
+        subtraction,
+        multiplication,
+        division
+    } type;
+
+    BinaryOperation(Type type, Element *lhs, Element *rhs) : lhs(lhs), rhs(rhs), type(type) {}
+
+    /**
+     * @brief Throws `std::runtime_error` on a division by zero or a result out of the range of int.
+     */
+    int eval(const int *variables) override
+    {
+        int left = lhs->eval(variables);
+        return Program::apply(Program::Op(Program::add + type), left, rhs->eval(variables));
+    }
+
+    void compile(Program &program) const override
+    {
+        lhs->compile(program);
+        if (auto constant = dynamic_cast<const Integer *>(rhs))
+            return program.emit(Program::Op(Program::add_constant + type), constant->value);
+        rhs->compile(program);
+        program.emit(Program::Op(Program::add + type));
+    }
+};
+
+/**
+ * @brief Parses the tokens into their OOP-counterparts by precedence climbing, making every node in the arena.
+ * Binary operators are left associative, `*` and `/` bind tighter than `+` and `-`, and a unary minus binds tighter than both.
+ */
+class Parser
+{
+    const std::vector<Token> &tokens;
+    std::string_view source;
+    Arena &arena;
+    // Names of the variables in the order they are first seen, nullptr if variables are not allowed.
+    std::vector<std::string> *variables;
+    size_t pos{0};
+    size_t depth{0};
+    // Height of the tree last returned by expression() or operand().
+    size_t height{0};
+
+    // Guards the stack against pathologically nested input, bounding both the recursion of the parser and the height of the tree,
+    // as evaluating and compiling recurse once per level of the tree. Every level of parentheses costs the parser two frames,
+    // so this stays well within a 1 MB stack, the default on Windows and for many worker threads.
+    static constexpr size_t max_depth = 1000;
+
+    // Binding power of a binary operator token, 0 for anything else.
+    static int precedence(Token::TokenType type)
+    {
+        switch (type)
+        {
+        case Token::plus:
+        case Token::minus:
+            return 1;
+        case Token::times:
+        case Token::divide:
+            return 2;
+        default:
+            return 0;
+        }
+    }
+
+    static BinaryOperation::Type operation(Token::TokenType type)
+    {
+        switch (type)
+        {
+        case Token::plus:
+            return BinaryOperation::addition;
+        case Token::minus:
+            return BinaryOperation::subtraction;
+        case Token::times:
+            return BinaryOperation::multiplication;
+        default:
+            return BinaryOperation::division;
+        }
+    }
+
+    [[noreturn]] void fail(const std::string &what) const
+    {
+        throw std::runtime_error(what + " at token " + std::to_string(pos) + ".");
+    }
+
+    // Parses operands joined by binary operators binding at least as tight as `min_precedence`.
+    Element *expression(int min_precedence)
+    {
+        if (++depth > max_depth)
+            fail("Expression nested too deep");
+        Element *lhs = operand();
+        size_t lhs_height = height;
+        while (pos < tokens.size() && precedence(tokens[pos].type) >= min_precedence)
+        {
+            Token::TokenType type = tokens[pos++].type;
+            Element *rhs = expression(precedence(type) + 1);
+            // A chain of operators deepens the tree without nesting the parser.
+            lhs_height = std::max(lhs_height, height) + 1;
+            if (lhs_height > max_depth)
+                fail("Expression nested too deep");
+            lhs = arena.make<BinaryOperation>(operation(type), lhs, rhs);
+        }
+        depth--;
+        height = lhs_height;
+        return lhs;
+    }
+
+    // Parses an integer, a variable, a negated operand or a parenthesized expression.
+    Element *operand()
+    {
+        if (pos == tokens.size())
+            fail("Missing operand");
+        const Token &token = tokens[pos++];
+        switch (token.type)
+        {
+        case Token::integer:
+            height = 1;
+            return arena.make<Integer>(token.value);
+        case Token::identifier:
+        {
+            if (!variables)
+            {
+                pos--;
+                fail("Unexpected variable " + std::string(token.text(source)));
+            }
+            std::string_view name = token.text(source);
+            size_t index = std::find(variables->begin(), variables->end(), name) - variables->begin();
+            if (index == variables->size())
+                variables->emplace_back(name);
+            height = 1;
+            return arena.make<Variable>(index);
+        }
+        case Token::minus:
+        {
+            // Stops at binary operators so that -2*3 is (-2)*3.
+            if (++depth > max_depth)
+                fail("Expression nested too deep");
+            Element *negated = arena.make<Negation>(operand());
+            if (++height > max_depth)
+                fail("Expression nested too deep");
+            depth--;
+            return negated;
+        }
+        case Token::lparen:
+        {
+            Element *inner = expression(1);
+            if (pos == tokens.size() || tokens[pos].type != Token::rparen)
+                fail("Missing ')'");
+            pos++;
+            return inner;
+        }
+        default:
+            pos--;
+            fail("Unexpected " + std::string(token.text(source)));
+        }
+    }
+
+public:
+    Parser(const std::vector<Token> &tokens, std::string_view source, Arena &arena, std::vector<std::string> *variables = nullptr)
+        : tokens(tokens), source(source), arena(arena), variables(variables) {}
+
+    /**
+     * @brief Parses all the tokens as a single expression. Throws `std::runtime_error` on a malformed one.
+     */
+    Element *parse()
+    {
+        Element *res = expression(1);
+        if (pos != tokens.size())
+            fail("Unexpected " + std::string(tokens[pos].text(source)));
+        return res;
+    }
+};
+
+/**
+ * @brief Parses all the tokens lexed from `source` into their OOP-counterparts that can be evaulated, the nodes live as long as the arena.
+ */
+inline Element *parse(const std::vector<Token> &tokens, std::string_view source, Arena &arena)
+{
+    return Parser(tokens, source, arena).parse();
+}
+
+/**
+ * @brief Same as above for an expression with variables, whose names are appended to `variables` in the order of their indices.
+ */
+inline Element *parse(const std::vector<Token> &tokens, std::string_view source, Arena &arena, std::vector<std::string> &variables)
+{
+    return Parser(tokens, source, arena, &variables).parse();
+}
+
+/**
+ * @brief A parsed expression along with the arena holding its nodes, which are all freed together with it.
+ * Variables are numbered in the order they first appear, values are passed in that order.
+ */
+class Expression
+{
+    Arena arena;
+    std::vector<std::string> names;
+    Element *root;
+
+public:
+    explicit Expression(std::string_view text) : root(::parse(lexer(text), text, arena, names)) {}
+
+    // Names of the variables, by index.
+    const std::vector<std::string> &variables() const
+    {
+        return names;
+    }
+
+    /**
+     * @brief Evaluates the expression with one value per variable. Throws `std::runtime_error` if the count does not match.
+     */
+    int eval(const std::vector<int> &values = {}) const
+    {
+        if (values.size() != names.size())
+            throw std::runtime_error("Expected " + std::to_string(names.size()) + " values, got " + std::to_string(values.size()) + ".");
+        return root->eval(values.data());
+    }
+
+    // Lowers the expression to bytecode, to be run as many times as needed.
+    Program compile() const
+    {
+        Program program(names.size());
+        root->compile(program);
+        return program;
+    }
+
+    // Bytes taken by the nodes.
+    size_t memory() const
+    {
+        return arena.memory();
+    }
+};
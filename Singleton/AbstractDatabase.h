@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Interface for Database classes.
+ */
+class AbstractDatabase
+{
+public:
+    virtual ~AbstractDatabase() = default;
+
+    virtual int64_t get_population(const std::string &country) = 0;
+
+    /**
+     * @brief Returns the sum of the populations of `count` countries, in a single call rather than one per country.
+     * Databases that can look many keys up faster than one at a time override it, the default just calls `get_population`.
+     */
+    virtual int64_t total_population(const std::string *countries, size_t count)
+    {
+        int64_t res = 0;
+        for (size_t i = 0; i < count; i++)
+            res += get_population(countries[i]);
+        return res;
+    }
+};
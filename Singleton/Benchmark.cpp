@@ -0,0 +1,130 @@
+/**
+ * @brief Benchmarks for the population Database.
+ * Compares the mmap/from_chars CSV loader against the getline/substr/stoi loader it replaced, on a generated file,
+ * then the cost per key of summing populations one lookup at a time against the batched lookup,
+ * and finally whole-table aggregates over the map against the population column.
+ */
+
+#include "AbstractDatabase.h"
+#include "PopulationLoader.h"
+#include "PopulationSnapshot.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Loader the Database used before, kept as the baseline.
+ */
+std::map<std::string, int> legacy_load(const std::string &path)
+{
+    std::map<std::string, int> populations;
+    std::ifstream ifs(path);
+    std::string line;
+    while (std::getline(ifs, line))
+    {
+        std::string country = line.substr(0, line.find_first_of(','));
+        std::string population = line.substr(line.find_first_of(',') + 1, line.size());
+        populations[country] = std::stoi(population);
+    }
+    return populations;
+}
+
+/**
+ * @brief Database over a snapshot, used through the interface the way RecordFinder uses the actual Database.
+ */
+class SnapshotDatabase : public AbstractDatabase
+{
+    const PopulationSnapshot &snapshot;
+
+public:
+    explicit SnapshotDatabase(const PopulationSnapshot &snapshot) : snapshot(snapshot) {}
+
+    int64_t get_population(const std::string &country)
+    {
+        return snapshot.get(country);
+    }
+
+    int64_t total_population(const std::string *countries, size_t count)
+    {
+        return snapshot.total(countries, count);
+    }
+};
+
+// Runs the function and returns the time it took in seconds.
+template <typename F>
+double time_seconds(F &&f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+    // Number of rows of the generated table, can be given as the first argument.
+    size_t rows = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+    const std::string path = "bench_db.csv";
+    {
+        std::ofstream ofs(path);
+        for (size_t i = 0; i < rows; i++)
+            ofs << "Country " << i * 2654435761u % 1000000007u << ',' << i % 1500 << '\n';
+    }
+
+    size_t checksum = 0;
+    PopulationSnapshot snapshot;
+    std::map<std::string, int> legacy;
+    double mapped_s = time_seconds([&]
+                                   { snapshot = load_populations(path); });
+    double legacy_s = time_seconds([&]
+                                   { legacy = legacy_load(path); });
+    std::remove(path.c_str());
+
+    std::cout << "Rows :: " << rows << "\n";
+    std::cout << "getline/stoi loader    :: " << rows / legacy_s << " rows/s\n";
+    std::cout << "mmap/from_chars loader :: " << rows / mapped_s << " rows/s\n";
+
+    // Keys in a random order over the whole table, one in eight of them missing.
+    std::vector<std::string> countries;
+    for (size_t i = 0; i < 1000000 && rows; i++)
+    {
+        size_t row = i * 40503u % rows;
+        countries.push_back(i % 8 ? std::string(snapshot.country(row)) : "Nowhere " + std::to_string(i));
+    }
+    SnapshotDatabase db(snapshot);
+    AbstractDatabase &database = db;
+    double single_s = time_seconds([&]
+                                   {
+        for (auto &country : countries)
+            checksum += database.get_population(country); });
+    double batched_s = time_seconds([&]
+                                    { checksum += database.total_population(countries.data(), countries.size()); });
+
+    std::cout << "Keys :: " << countries.size() << "\n";
+    std::cout << "Single lookups  :: " << single_s * 1e9 / countries.size() << " ns/key\n";
+    std::cout << "Batched lookups :: " << batched_s * 1e9 / countries.size() << " ns/key\n";
+    int64_t map_sum = 0;
+    double map_sum_s = time_seconds([&]
+                                    {
+        for (auto &[country, population] : legacy)
+            map_sum += population; });
+    std::pair<size_t, int64_t> column_sum;
+    double column_sum_s = time_seconds([&]
+                                       { column_sum = snapshot.sum_between(0, INT64_MAX); });
+    size_t top = 0;
+    double top_s = time_seconds([&]
+                                { top = snapshot.top(10).front(); });
+    checksum += map_sum + column_sum.second + top;
+
+    std::cout << "Sum over the map    :: " << map_sum_s * 1e9 / rows << " ns/row\n";
+    std::cout << "Sum over the column :: " << column_sum_s * 1e9 / rows << " ns/row\n";
+    std::cout << "Top 10 of the column :: " << top_s * 1e9 / rows << " ns/row\n";
+    std::cout << "Checksum :: " << checksum << "\n";
+    return 0;
+}
@@ -0,0 +1,64 @@
+/**
+ * @brief Converts the binary event logs written by the EventLogger Multiton back to text.
+ * Usage: Decoder <file.evlog>... prints one line per event, as "<UTC time> [<logger>] <event>: <payload>", or only the payload of an event without text.
+ */
+
+#include "EventLog.h"
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+// Formats nanoseconds since the Unix epoch as a UTC date and time.
+std::string format_time(uint64_t timestamp)
+{
+    std::time_t seconds = static_cast<std::time_t>(timestamp / 1000000000);
+    std::tm utc{};
+#if defined(_WIN32)
+    gmtime_s(&utc, &seconds);
+#else
+    gmtime_r(&seconds, &utc);
+#endif
+    char text[48];
+    size_t size = std::strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &utc);
+    std::snprintf(text + size, sizeof(text) - size, ".%09llu", static_cast<unsigned long long>(timestamp % 1000000000));
+    return text;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <file.evlog>...\n";
+        return 1;
+    }
+
+    int status = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        std::ifstream ifs(argv[i], std::ios::binary);
+        std::string data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        try
+        {
+            EventLogReader reader(data);
+            EventRecord record;
+            std::string_view text;
+            while (reader.next(record, text))
+            {
+                std::cout << format_time(record.timestamp) << " [" << reader.logger() << "] " << text;
+                if (!record.payload.empty())
+                    std::cout << (text.empty() ? "" : ": ") << record.payload;
+                std::cout << '\n';
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << argv[i] << ": " << e.what() << '\n';
+            status = 1;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,191 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Binary format of the event log files, shared by the loggers and the decoder.
+ * A file starts with the magic, a version byte and the name of the logger, then holds records each starting with a tag byte:
+ * a definition gives the text of an event id the first time the file uses it, an event gives its timestamp, severity, id and payload.
+ * Integers are LEB128 varints and timestamps are zigzag-encoded deltas from the previous event, so most events take a handful of bytes.
+ */
+struct EventLogFormat
+{
+    static constexpr char magic[5] = {'E', 'V', 'L', 'O', 'G'};
+    static constexpr uint8_t version = 1;
+    static constexpr uint8_t definition_tag = 'D';
+    static constexpr uint8_t event_tag = 'E';
+};
+
+/**
+ * @brief An event as stored in a log, the timestamp is in nanoseconds since the Unix epoch.
+ */
+struct EventRecord
+{
+    uint64_t timestamp;
+    uint8_t severity;
+    uint32_t id;
+    std::string_view payload;
+};
+
+/**
+ * @brief Appends the records of a log file to a buffer.
+ */
+class EventLogWriter
+{
+    uint64_t last_timestamp = 0;
+    // Whether each event id has been defined in this file.
+    std::vector<bool> defined;
+
+    static void put_varint(std::string &out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    static void put_text(std::string &out, std::string_view text)
+    {
+        put_varint(out, text.size());
+        out.append(text);
+    }
+
+public:
+    // Writes the start of the file.
+    void header(std::string &out, std::string_view logger)
+    {
+        out.append(EventLogFormat::magic, sizeof(EventLogFormat::magic));
+        out.push_back(static_cast<char>(EventLogFormat::version));
+        put_text(out, logger);
+    }
+
+    // Whether the file already has the text of the event id.
+    bool is_defined(uint32_t id) const
+    {
+        return id < defined.size() && defined[id];
+    }
+
+    void definition(std::string &out, uint32_t id, std::string_view text)
+    {
+        if (id >= defined.size())
+            defined.resize(id + 1);
+        defined[id] = true;
+        out.push_back(static_cast<char>(EventLogFormat::definition_tag));
+        put_varint(out, id);
+        put_text(out, text);
+    }
+
+    void event(std::string &out, const EventRecord &record)
+    {
+        int64_t delta = static_cast<int64_t>(record.timestamp - last_timestamp);
+        last_timestamp = record.timestamp;
+        out.push_back(static_cast<char>(EventLogFormat::event_tag));
+        put_varint(out, (uint64_t(delta) << 1) ^ uint64_t(delta >> 63));
+        out.push_back(static_cast<char>(record.severity));
+        put_varint(out, record.id);
+        put_text(out, record.payload);
+    }
+};
+
+/**
+ * @brief Reads the events of a log file held in memory, resolving their ids to the texts defined before them.
+ * Throws `std::runtime_error` on a file that is not an event log or is cut short.
+ */
+class EventLogReader
+{
+    std::string_view data;
+    size_t pos = 0;
+    uint64_t last_timestamp = 0;
+    std::string_view logger_name;
+    std::vector<std::string_view> texts;
+
+    uint8_t get_byte()
+    {
+        if (pos >= data.size())
+            throw std::runtime_error("Event log is truncated.");
+        return static_cast<uint8_t>(data[pos++]);
+    }
+
+    uint64_t get_varint()
+    {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            uint8_t byte = get_byte();
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (byte < 0x80)
+                return value;
+        }
+        throw std::runtime_error("Event log has an invalid varint.");
+    }
+
+    std::string_view get_text()
+    {
+        uint64_t size = get_varint();
+        if (size > data.size() - pos)
+            throw std::runtime_error("Event log is truncated.");
+        std::string_view text = data.substr(pos, size);
+        pos += size;
+        return text;
+    }
+
+public:
+    explicit EventLogReader(std::string_view data) : data(data)
+    {
+        if (data.size() < sizeof(EventLogFormat::magic) || std::memcmp(data.data(), EventLogFormat::magic, sizeof(EventLogFormat::magic)) != 0)
+            throw std::runtime_error("Not an event log.");
+        pos = sizeof(EventLogFormat::magic);
+        if (get_byte() != EventLogFormat::version)
+            throw std::runtime_error("Unsupported event log version.");
+        logger_name = get_text();
+    }
+
+    // Name of the logger that wrote the file.
+    std::string_view logger() const
+    {
+        return logger_name;
+    }
+
+    /**
+     * @brief Reads the next event into `record` and its text into `text`, returns false at the end of the file.
+     */
+    bool next(EventRecord &record, std::string_view &text)
+    {
+        while (pos < data.size())
+        {
+            uint8_t tag = get_byte();
+            if (tag == EventLogFormat::definition_tag)
+            {
+                uint64_t id = get_varint();
+                if (id >= UINT32_MAX)
+                    throw std::runtime_error("Event log has an invalid event id.");
+                if (id >= texts.size())
+                    texts.resize(id + 1);
+                texts[id] = get_text();
+                continue;
+            }
+            if (tag != EventLogFormat::event_tag)
+                throw std::runtime_error("Event log has an unknown record.");
+
+            uint64_t zigzag = get_varint();
+            last_timestamp += static_cast<uint64_t>(int64_t(zigzag >> 1) ^ -int64_t(zigzag & 1));
+            record.timestamp = last_timestamp;
+            record.severity = get_byte();
+            uint64_t id = get_varint();
+            if (id >= texts.size())
+                throw std::runtime_error("Event log uses an undefined event id.");
+            record.id = static_cast<uint32_t>(id);
+            record.payload = get_text();
+            text = texts[id];
+            return true;
+        }
+        return false;
+    }
+};
@@ -0,0 +1,119 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+/**
+ * @brief Limits of the events a logger accepts, the defaults accept everything.
+ */
+struct EventLimits
+{
+    // Sustained rate of the token bucket, 0 for no limit.
+    double events_per_second = 0;
+    // Events that can go through at once after a quiet period, i.e. the size of the bucket.
+    double burst = 1;
+    // Probability of keeping an event, checked before the rate limit.
+    double sample_rate = 1;
+};
+
+/**
+ * @brief Counts of the events a logger dropped.
+ */
+struct EventDrops
+{
+    uint64_t rate_limited = 0;
+    uint64_t sampled_out = 0;
+};
+
+/**
+ * @brief Decides whether an event is logged, with probabilistic sampling followed by a token bucket, without taking any lock.
+ * The bucket is kept as the single time at which it would be full again (GCRA), so taking a token is one compare-and-swap.
+ */
+class EventThrottle
+{
+    static constexpr uint64_t keep_all = uint64_t(1) << 32;
+
+    // Nanoseconds a token takes to come back, 0 when not rate limited.
+    std::atomic<int64_t> interval{0};
+    // Nanoseconds of tokens the bucket holds.
+    std::atomic<int64_t> capacity{0};
+    // Time at which all the tokens taken so far are back.
+    std::atomic<int64_t> refilled_at{0};
+    // An event is kept when a random 32-bit number is below it.
+    std::atomic<uint64_t> keep_below{keep_all};
+    std::atomic<uint64_t> rate_limited{0};
+    std::atomic<uint64_t> sampled_out{0};
+
+    // Per-thread xorshift generator, good enough for sampling and free of shared state.
+    static uint32_t random()
+    {
+        thread_local uint64_t state = std::hash<std::thread::id>{}(std::this_thread::get_id()) | 1;
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return static_cast<uint32_t>(state >> 32);
+    }
+
+public:
+    void configure(const EventLimits &limits)
+    {
+        int64_t step = limits.events_per_second > 0 ? static_cast<int64_t>(1e9 / limits.events_per_second) : 0;
+        interval.store(step, std::memory_order_relaxed);
+        capacity.store(static_cast<int64_t>(std::max(limits.burst, 1.0) * step), std::memory_order_relaxed);
+        keep_below.store(static_cast<uint64_t>(std::clamp(limits.sample_rate, 0.0, 1.0) * keep_all), std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Returns whether an event occurring at `now`, in nanoseconds of a monotonic clock, is to be logged.
+     */
+    bool admit(int64_t now)
+    {
+        return admit_at([now]
+                        { return now; });
+    }
+
+    // Same as above for an event occurring now, the clock is only read when the rate is limited.
+    bool admit()
+    {
+        return admit_at([]
+                        { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); });
+    }
+
+    EventDrops drops() const
+    {
+        return {rate_limited.load(std::memory_order_relaxed), sampled_out.load(std::memory_order_relaxed)};
+    }
+
+private:
+    template <typename Clock>
+    bool admit_at(Clock &&clock)
+    {
+        uint64_t threshold = keep_below.load(std::memory_order_relaxed);
+        if (threshold < keep_all && random() >= threshold)
+        {
+            sampled_out.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        int64_t step = interval.load(std::memory_order_relaxed);
+        if (step == 0)
+            return true;
+        int64_t now = clock();
+        int64_t limit = capacity.load(std::memory_order_relaxed);
+        int64_t at = refilled_at.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            int64_t next = std::max(at, now) + step;
+            if (next - now > limit)
+            {
+                rate_limited.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (refilled_at.compare_exchange_weak(at, next, std::memory_order_relaxed))
+                return true;
+        }
+    }
+};
@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/**
+ * @brief Bounded lock-free queue for many producers and a single consumer.
+ * Every cell carries a sequence number telling whose turn it is: producers claim a position with a single CAS on the tail
+ * and publish the cell by bumping its sequence, the consumer only ever touches the cells it reads.
+ */
+template <typename T>
+class MpscRing
+{
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    const size_t mask;
+    // Producers and the consumer write their positions on different cache lines.
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) size_t head{0};
+
+public:
+    // The capacity is rounded up to a power of two.
+    explicit MpscRing(size_t capacity) : mask(round_up(capacity) - 1)
+    {
+        cells.reset(new Cell[mask + 1]);
+        for (size_t i = 0; i <= mask; i++)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    MpscRing(const MpscRing &) = delete;
+    MpscRing &operator=(const MpscRing &) = delete;
+
+    /**
+     * @brief Claims a cell and calls `fill` with its value to write the element in place. Returns false if the queue is full.
+     */
+    template <typename Fill>
+    bool try_push(Fill &&fill)
+    {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell &cell = cells[pos & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t lag = intptr_t(sequence) - intptr_t(pos);
+            if (lag == 0)
+            {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    fill(cell.value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (lag < 0)
+                return false;
+            else
+                pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Calls `consume` with the oldest element if there is one, then frees its cell. Only one thread may pop.
+     */
+    template <typename Consume>
+    bool try_pop(Consume &&consume)
+    {
+        Cell &cell = cells[head & mask];
+        if (cell.sequence.load(std::memory_order_acquire) != head + 1)
+            return false;
+        consume(cell.value);
+        cell.sequence.store(head + mask + 1, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+private:
+    static size_t round_up(size_t capacity)
+    {
+        size_t res = 2;
+        while (res < capacity)
+            res *= 2;
+        return res;
+    }
+};
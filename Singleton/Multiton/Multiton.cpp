@@ -4,9 +4,28 @@
  * @brief Multiton Pattern can be exemplified by an EventLogger class that stores Events in different files based on their severity i.e. High, Medium, Low etc.
  */
 
+#include "EventLog.h"
+#include "EventThrottle.h"
+#include "MpscRing.h"
+#include "Multiton.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <gtest/gtest.h>
 #include <iostream>
+#include <iterator>
 #include <map>
+#include <memory>
+#include <shared_mutex>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 /**
  * @brief Stores the Severity of Events on the basis of which Event Logger Singleton Objects are created.
@@ -18,25 +37,142 @@ enum EventSeverity
     Normal
 };
 
+/**
+ * @brief Interns the texts of events, so that loggers queue and store a small id rather than the text.
+ * Only texts callers ask an id for are interned, so the table stays as small as the set of events logged by id.
+ */
+class EventNames
+{
+    static inline std::shared_mutex mutex;
+    static inline std::map<std::string, uint32_t, std::less<>> ids{{std::string(), 0}};
+    // Texts by id, a deque so that they never move.
+    static inline std::deque<std::string> texts{std::string()};
+    // Number of ids given so far, so that ids can be checked without taking the lock.
+    static inline std::atomic<uint32_t> count{1};
+
+public:
+    // Id of the empty text, for events whose whole text is their payload.
+    static constexpr uint32_t message = 0;
+
+    // Returns the id of the text, giving it a new one on its first use.
+    static uint32_t id(std::string_view text)
+    {
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            auto it = ids.find(text);
+            if (it != ids.end())
+                return it->second;
+        }
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        auto it = ids.find(text);
+        if (it != ids.end())
+            return it->second;
+        uint32_t id = static_cast<uint32_t>(texts.size());
+        texts.emplace_back(text);
+        ids.emplace(texts.back(), id);
+        count.store(id + 1, std::memory_order_release);
+        return id;
+    }
+
+    // Whether the id was returned by `id`.
+    static bool valid(uint32_t id)
+    {
+        return id < count.load(std::memory_order_acquire);
+    }
+
+    // Returns the text of an id returned by `id`.
+    static std::string_view text(uint32_t id)
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return texts[id];
+    }
+};
+
 /**
  * @brief Multiple Singleton Objects of EventLogger are created.
+ * Callers only copy the event into a lock-free ring, a background thread per logger encodes the events and writes them to its file in batches.
+ * Files use the binary format of EventLog.h, which the Decoder turns back into text.
  */
 class EventLogger
 {
     static int id;
 
+    // An event as queued, longer payloads are truncated to fit.
+    struct Event
+    {
+        uint64_t timestamp;
+        uint32_t id;
+        uint8_t severity;
+        uint8_t size;
+        char payload[114];
+    };
+
+    MpscRing<Event> queue{8192};
+    std::ofstream file;
+    std::string name;
+    std::atomic<bool> stopping{false};
+    // Declared last so that it starts once everything it uses is constructed.
+    std::thread writer;
+
     // Contructor is private so that only friend class EventLoggerMultiton can create the objects of Event Logger.
-    EventLogger() {
+    EventLogger(const std::string &name, const std::string &path) : file(path, std::ios::binary | std::ios::trunc), name(name), writer([this]
+                                                                                                                                     { write_events(); })
+    {
         std::cout << ++id << " Loggers created so far...\n";
     }
     friend class EventLoggerMultiton;
+    friend struct std::default_delete<EventLogger>;
+
+    // Writes all the queued events before stopping.
+    ~EventLogger()
+    {
+        stopping = true;
+        writer.join();
+    }
+
+    // Stores event to a EventLogger, only waits if the writer has fallen a whole ring behind.
+    void add_event(uint32_t event_id, std::string_view payload, uint8_t severity)
+    {
+        uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        size_t size = std::min(payload.size(), sizeof(Event::payload));
+        while (!queue.try_push([&](Event &queued)
+                               {
+            queued.timestamp = timestamp;
+            queued.id = event_id;
+            queued.severity = severity;
+            queued.size = static_cast<uint8_t>(size);
+            std::memcpy(queued.payload, payload.data(), size); }))
+            std::this_thread::yield();
+    }
 
-    // Stores event to a EventLogger.
-    void add_event(std::string event)
+    // Body of the writer thread, gathers whatever is queued into one write and sleeps when there is nothing.
+    void write_events()
     {
-        std::cout << "Event \"" << event << "\" Logged ";
+        EventLogWriter encoder;
+        std::string batch;
+        encoder.header(batch, name);
+        for (;;)
+        {
+            // Read before draining so that nothing queued before the stop is left behind.
+            bool stop = stopping.load();
+            while (queue.try_pop([&](const Event &event)
+                                 {
+                if (!encoder.is_defined(event.id))
+                    encoder.definition(batch, event.id, EventNames::text(event.id));
+                encoder.event(batch, {event.timestamp, event.severity, event.id, std::string_view(event.payload, event.size)}); }))
+                ;
+            if (!batch.empty())
+            {
+                file.write(batch.data(), batch.size());
+                file.flush();
+                batch.clear();
+            }
+            else if (stop)
+                return;
+            else
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
     }
-    
 };
 
 int EventLogger::id = 0;
@@ -46,23 +182,91 @@ int EventLogger::id = 0;
  */
 class EventLoggerMultiton
 {
-    // Stores the Singleton Objects of EventLogger.
-    static std::map<EventSeverity, EventLogger *> loggers;
+    // Stores the Singleton Objects of EventLogger, one slot per EventSeverity.
+    static Multiton<EventSeverity, EventLogger, EventSeverity::Normal + 1> loggers;
+    // Sampling and rate limits of every EventSeverity, checked before the logger is even looked up.
+    static inline EventThrottle throttles[EventSeverity::Normal + 1];
+    // Put before the file name of the loggers, e.g. a directory.
+    static inline std::string path_prefix;
+
+    // Queues an event that was let through to the EventLogger of its severity, creating the logger on first use.
+    static void log(uint32_t event_id, std::string_view payload, EventSeverity severity)
+    {
+        loggers.get(severity, [severity]
+                    { return new EventLogger(get_severity(severity), path_prefix + get_severity(severity) + ".evlog"); })
+            .add_event(event_id, payload, static_cast<uint8_t>(severity));
+    }
 
 public:
-    // Adds event to appropriate EventLogger Singleton Object.
-    static void add_event(std::string event_desc, EventSeverity severity = EventSeverity::Normal)
+    /**
+     * @brief Adds event to appropriate EventLogger Singleton Object.
+     * The text is logged as the payload of a fixed id rather than interned, so texts that vary from one event to the next cost no memory
+     * and no definition in the file. Like any payload, it is truncated past 114 bytes.
+     */
+    static void add_event(std::string_view event_desc, EventSeverity severity = EventSeverity::Normal)
     {
-        if (loggers.find(severity) == loggers.end())
-        {
-            loggers[severity] = new EventLogger();
-        }
+        if (!throttles[severity].admit())
+            return;
+        log(EventNames::message, event_desc, severity);
+    }
 
-        loggers[severity]->add_event(event_desc);
-        
-        std::cout << " to " << get_severity(severity) << " Logger.\n";
+    /**
+     * @brief Adds an event given by the id of its text and a payload, which skips looking the text up on every event.
+     * Throws std::out_of_range for an id that `event_id` did not return, rather than leaving the writer thread to look it up.
+     */
+    static void add_event(uint32_t event_id, std::string_view payload, EventSeverity severity = EventSeverity::Normal)
+    {
+        if (!EventNames::valid(event_id))
+            throw std::out_of_range("Unknown event id " + std::to_string(event_id) + ".");
+        if (!throttles[severity].admit())
+            return;
+        log(event_id, payload, severity);
     }
-    
+
+    /**
+     * @brief Sets the prefix of the file paths of the loggers created from now on.
+     * !@warning Must not run while other threads log events.
+     */
+    static void set_path_prefix(const std::string &prefix)
+    {
+        path_prefix = prefix;
+    }
+
+    /**
+     * @brief Destroys the loggers once they have written all their events and closed their files, the next events create new ones.
+     * !@warning Must not run while other threads log events.
+     */
+    static void clear()
+    {
+        loggers.clear();
+    }
+
+    // Number of loggers created so far.
+    static int loggers_created()
+    {
+        return EventLogger::id;
+    }
+
+    /**
+     * @brief Sets how many events of the severity are sampled and let through, so that floods of events keep the cost of logging bounded.
+     */
+    static void set_limits(EventSeverity severity, const EventLimits &limits)
+    {
+        throttles[severity].configure(limits);
+    }
+
+    // Returns the counts of events of the severity dropped so far.
+    static EventDrops drops(EventSeverity severity)
+    {
+        return throttles[severity].drops();
+    }
+
+    // Returns the id of an event text, to be kept by callers that log the same event often. Ids are never freed, so only fixed texts should get one.
+    static uint32_t event_id(std::string_view event_desc)
+    {
+        return EventNames::id(event_desc);
+    }
+
     // Converts EventSeverity enum values to strings.
     static std::string get_severity(EventSeverity severity) {
         std::string severity_str = "";
@@ -86,9 +290,171 @@ public:
 };
 
 // Initialization of static logers' list
-std::map<EventSeverity, EventLogger *> EventLoggerMultiton::loggers;
+Multiton<EventSeverity, EventLogger, EventSeverity::Normal + 1> EventLoggerMultiton::loggers;
+
+/**
+ * Threads racing on the first use of a key all get the one instance that was created.
+ */
+TEST(MultitonTests, ConcurrentFirstUseCreatesOneInstance)
+{
+    static std::atomic<int> created{0};
+    struct Counted
+    {
+        Counted() { created++; }
+    };
+    Multiton<EventSeverity, Counted, EventSeverity::Normal + 1> registry;
 
-int main()
+    std::vector<std::thread> threads;
+    std::vector<Counted *> seen(16);
+    for (size_t i = 0; i < seen.size(); i++)
+        threads.emplace_back([&, i]
+                             { seen[i] = &registry.get(EventSeverity::Warning, []
+                                                       { return new Counted(); }); });
+    for (auto &thread : threads)
+        thread.join();
+
+    EXPECT_EQ(created, 1);
+    for (auto instance : seen)
+        EXPECT_EQ(instance, seen[0]);
+}
+
+/**
+ * Events added from many threads at once to all the loggers all reach their files, through a single logger per severity.
+ */
+TEST(MultitonTests, AddEventFromManyThreads)
+{
+    // Fresh loggers writing to files of their own, which are removed at the end.
+    EventLoggerMultiton::clear();
+    EventLoggerMultiton::set_path_prefix("stress_");
+    int created = EventLoggerMultiton::loggers_created();
+    uint32_t stress = EventLoggerMultiton::event_id("Stress event");
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; t++)
+        threads.emplace_back([t, stress]
+                             {
+            for (int i = 0; i < 20000; i++)
+                EventLoggerMultiton::add_event(stress, {}, EventSeverity((t + i) % (EventSeverity::Normal + 1))); });
+    for (auto &thread : threads)
+        thread.join();
+    EXPECT_EQ(EventLoggerMultiton::loggers_created() - created, EventSeverity::Normal + 1);
+
+    // Destroying the loggers waits for them to write everything.
+    EventLoggerMultiton::clear();
+    EventLoggerMultiton::set_path_prefix("");
+    size_t events = 0;
+    for (int severity = 0; severity <= EventSeverity::Normal; severity++)
+    {
+        std::string path = "stress_" + EventLoggerMultiton::get_severity(EventSeverity(severity)) + ".evlog";
+        std::string data;
+        {
+            std::ifstream ifs(path, std::ios::binary);
+            data.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+        }
+        std::remove(path.c_str());
+
+        EventLogReader reader(data);
+        EventRecord record;
+        std::string_view text;
+        while (reader.next(record, text))
+        {
+            EXPECT_EQ(record.severity, severity);
+            events += record.id == stress;
+        }
+    }
+    EXPECT_EQ(events, 160000u);
+}
+
+/**
+ * Ids that were never given out are rejected when the event is added, so that the writer thread only ever sees valid ones.
+ */
+TEST(MultitonTests, UnknownEventIdIsRejected)
+{
+    EXPECT_THROW(EventLoggerMultiton::add_event(123456u, "x", EventSeverity::Critical), std::out_of_range);
+    uint32_t known = EventLoggerMultiton::event_id("Known event");
+    EXPECT_THROW(EventLoggerMultiton::add_event(known + 1, "x", EventSeverity::Critical), std::out_of_range);
+}
+
+/**
+ * The token bucket lets a burst through, then one event per interval, and counts the rest.
+ */
+TEST(EventThrottleTests, RateLimit)
+{
+    EventThrottle throttle;
+    throttle.configure({1000, 10, 1});
+
+    int64_t now = 5000000000;
+    int admitted = 0;
+    for (int i = 0; i < 20; i++)
+        admitted += throttle.admit(now);
+    EXPECT_EQ(admitted, 10);
+    EXPECT_EQ(throttle.drops().rate_limited, 10u);
+
+    // A token comes back every millisecond.
+    EXPECT_TRUE(throttle.admit(now + 1000000));
+    EXPECT_FALSE(throttle.admit(now + 1000000));
+    EXPECT_EQ(throttle.drops().sampled_out, 0u);
+}
+
+/**
+ * Sampling keeps about the requested share of the events.
+ */
+TEST(EventThrottleTests, Sampling)
+{
+    EventThrottle throttle;
+    throttle.configure({0, 1, 0.25});
+
+    int admitted = 0;
+    for (int i = 0; i < 100000; i++)
+        admitted += throttle.admit();
+    EXPECT_NEAR(admitted, 25000, 1000);
+    EXPECT_EQ(throttle.drops().sampled_out, 100000u - admitted);
+    EXPECT_EQ(throttle.drops().rate_limited, 0u);
+
+    throttle.configure({});
+    EXPECT_TRUE(throttle.admit());
+}
+
+/**
+ * Records written in the binary format read back the same, with their texts defined once.
+ */
+TEST(EventLogTests, RoundTrip)
+{
+    EventLogWriter writer;
+    std::string file;
+    writer.header(file, "Warning");
+    writer.definition(file, 3, "Disk usage above threshold");
+    writer.event(file, {1000000000, EventSeverity::Warning, 3, "91%"});
+    // Timestamps of events queued from different threads may go backwards.
+    writer.event(file, {999999000, EventSeverity::Warning, 3, ""});
+
+    EventLogReader reader(file);
+    EXPECT_EQ(reader.logger(), "Warning");
+    EventRecord record;
+    std::string_view text;
+    ASSERT_TRUE(reader.next(record, text));
+    EXPECT_EQ(record.timestamp, 1000000000u);
+    EXPECT_EQ(record.severity, EventSeverity::Warning);
+    EXPECT_EQ(text, "Disk usage above threshold");
+    EXPECT_EQ(record.payload, "91%");
+    ASSERT_TRUE(reader.next(record, text));
+    EXPECT_EQ(record.timestamp, 999999000u);
+    EXPECT_EQ(record.payload, "");
+    EXPECT_FALSE(reader.next(record, text));
+
+    auto read_all = [](std::string_view data)
+    {
+        EventLogReader reader(data);
+        EventRecord record;
+        std::string_view text;
+        while (reader.next(record, text))
+            ;
+    };
+    EXPECT_THROW(read_all(std::string_view(file).substr(0, file.size() - 1)), std::runtime_error);
+    EXPECT_THROW(read_all("Normal.log"), std::runtime_error);
+}
+
+int main(int argc, char *argv[])
 {
     // Replicates the Event Logging in Real-World Systems.
     EventLoggerMultiton::add_event("System Booted", EventSeverity::Normal);
@@ -97,5 +463,20 @@ int main()
     EventLoggerMultiton::add_event("System not responding", EventSeverity::Critical);
     EventLoggerMultiton::add_event("System Crashed", EventSeverity::Critical);
 
-    return 0;
+    // Events logged often keep the id of their text and only pass what changes.
+    uint32_t disk_usage = EventLoggerMultiton::event_id("Disk usage above threshold");
+    EventLoggerMultiton::add_event(disk_usage, "91%", EventSeverity::Warning);
+    EventLoggerMultiton::add_event(disk_usage, "97%", EventSeverity::Warning);
+    // During a flood only a sample of the Normal events is kept, and at most 100 per second of them.
+    EventLoggerMultiton::set_limits(EventSeverity::Normal, {100, 10, 0.5});
+    for (int i = 0; i < 1000; i++)
+        EventLoggerMultiton::add_event(disk_usage, "Flooding", EventSeverity::Normal);
+    EventDrops drops = EventLoggerMultiton::drops(EventSeverity::Normal);
+    std::cout << "Normal events dropped :: " << drops.sampled_out << " sampled out, " << drops.rate_limited << " rate limited\n";
+    EventLoggerMultiton::set_limits(EventSeverity::Normal, {});
+
+    std::cout << "Events are written to Normal.evlog, Warning.evlog and Critical.evlog, run the Decoder to read them\n";
+
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
 }
@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+/**
+ * @brief Registry of one lazily created instance per value of a small enum `Key`, safe to use from any number of threads.
+ * Instances sit in a fixed array of atomic slots, so once an instance exists looking it up is a single load, with no lock nor shared write.
+ * Creation is serialized, so that concurrent first uses of a key still create a single instance.
+ */
+template <typename Key, typename T, size_t Count>
+class Multiton
+{
+    std::atomic<T *> slots[Count] = {};
+    std::unique_ptr<T> owned[Count];
+    std::mutex creating;
+
+public:
+    /**
+     * @brief Returns the instance for `key`, creating it with `create()`, which returns a new T, if it does not exist yet.
+     */
+    template <typename Create>
+    T &get(Key key, Create &&create)
+    {
+        size_t index = static_cast<size_t>(key);
+        if (T *instance = slots[index].load(std::memory_order_acquire))
+            return *instance;
+
+        std::lock_guard<std::mutex> lock(creating);
+        if (T *instance = slots[index].load(std::memory_order_relaxed))
+            return *instance;
+        owned[index].reset(create());
+        slots[index].store(owned[index].get(), std::memory_order_release);
+        return *owned[index];
+    }
+
+    /**
+     * @brief Destroys every instance, the next `get` of a key creates a new one.
+     * !@warning Must not run while other threads use the registry or hold on to its instances.
+     */
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(creating);
+        for (size_t index = 0; index < Count; index++)
+        {
+            slots[index].store(nullptr, std::memory_order_relaxed);
+            owned[index].reset();
+        }
+    }
+};
@@ -0,0 +1,87 @@
+#pragma once
+#include "PopulationSnapshot.h"
+#include "boost/interprocess/file_mapping.hpp"
+#include "boost/interprocess/mapped_region.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Returns the position of the first ',' or '\n' in [pos, end), or end if there is none.
+ * Looks at 8 bytes at a time, testing all of them for both delimiters with a few word-wide operations.
+ */
+inline const char *find_delimiter(const char *pos, const char *end)
+{
+    constexpr uint64_t ones = 0x0101010101010101ull;
+    constexpr uint64_t highs = 0x8080808080808080ull;
+    for (; end - pos >= 8; pos += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, pos, 8);
+        uint64_t commas = word ^ (ones * ',');
+        uint64_t newlines = word ^ (ones * '\n');
+        // A byte of `commas` or `newlines` is zero where the delimiter is, this sets its high bit.
+        uint64_t found = ((commas - ones) & ~commas & highs) | ((newlines - ones) & ~newlines & highs);
+        if (found)
+            break;
+    }
+    while (pos < end && *pos != ',' && *pos != '\n')
+        pos++;
+    return pos;
+}
+
+/**
+ * @brief Loads a `country,population` CSV file into a snapshot.
+ * The file is memory mapped, rows are split in place and populations are parsed with `std::from_chars`, so nothing is allocated per row.
+ * Blank lines are skipped and lines may end in CRLF. The population may be preceded by spaces or tabs but must be a whole integer,
+ * a row without one throws std::runtime_error naming the file and line.
+ */
+inline PopulationSnapshot load_populations(const std::string &path)
+{
+    // An empty file cannot be mapped.
+    if (std::filesystem::file_size(path) == 0)
+        return PopulationSnapshot();
+
+    boost::interprocess::file_mapping file(path.c_str(), boost::interprocess::read_only);
+    boost::interprocess::mapped_region region(file, boost::interprocess::read_only);
+    region.advise(boost::interprocess::mapped_region::advice_sequential);
+    const char *pos = static_cast<const char *>(region.get_address());
+    const char *end = pos + region.get_size();
+
+    PopulationSnapshot::Builder builder(std::count(pos, end, '\n') + 1);
+    for (size_t line = 1; pos < end; line++)
+    {
+        const char *comma = find_delimiter(pos, end);
+        if (comma == end || *comma == '\n')
+        {
+            // Blank lines are skipped, anything else without a comma is malformed.
+            if (comma != pos && !(comma - pos == 1 && *pos == '\r'))
+                throw std::runtime_error(path + ":" + std::to_string(line) + " has no population.");
+            pos = comma + 1;
+            continue;
+        }
+
+        const char *line_end = static_cast<const char *>(std::memchr(comma, '\n', end - comma));
+        line_end = line_end ? line_end : end;
+        const char *value_end = line_end > comma && line_end[-1] == '\r' ? line_end - 1 : line_end;
+
+        // Like the stoi based loader, spaces after the comma are accepted.
+        const char *value = comma + 1;
+        while (value < value_end && (*value == ' ' || *value == '\t'))
+            value++;
+
+        int64_t population = 0;
+        auto [parsed, error] = std::from_chars(value, value_end, population);
+        if (error != std::errc() || parsed != value_end)
+            throw std::runtime_error(path + ":" + std::to_string(line) + " has an invalid population.");
+
+        builder.add(std::string_view(pos, comma - pos), population);
+        pos = line_end + 1;
+    }
+    return std::move(builder).build();
+}
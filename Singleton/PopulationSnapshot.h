@@ -0,0 +1,259 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Immutable, read-optimized population table built once at load.
+ * Country names are stored back to back in a single arena and found through an open-addressing hash index,
+ * so lookups never allocate nor mutate anything and are safe from any number of threads without locks.
+ * Populations are a contiguous column of 64-bit values, so that aggregates over the whole table are plain loops the compiler vectorizes.
+ */
+class PopulationSnapshot
+{
+public:
+    class Builder;
+
+    PopulationSnapshot()
+    {
+        slots.assign(16, empty);
+        offsets.push_back(0);
+    }
+
+    /**
+     * @brief Returns the population of the country, if present.
+     */
+    std::optional<int64_t> find(std::string_view country) const
+    {
+        uint32_t row = slots[probe(country, hash_of(country))];
+        if (row == empty)
+            return std::nullopt;
+        return populations[row];
+    }
+
+    /**
+     * @brief Returns the population of the country or 0 if it is not present.
+     */
+    int64_t get(std::string_view country) const
+    {
+        return find(country).value_or(0);
+    }
+
+    /**
+     * @brief Returns the sum of the populations of `count` countries, 0 for the ones not present.
+     * The index slot of each key is prefetched a few keys ahead, so that the cache misses of consecutive lookups overlap.
+     */
+    int64_t total(const std::string *countries, size_t count) const
+    {
+        // Hashes of the keys in flight, the one of key i is at i % lookahead.
+        constexpr size_t lookahead = 8;
+        uint32_t ahead[lookahead];
+        for (size_t i = 0; i < count && i < lookahead; i++)
+            ahead[i] = prefetch(countries[i]);
+
+        int64_t res = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t hash = ahead[i % lookahead];
+            if (i + lookahead < count)
+                ahead[i % lookahead] = prefetch(countries[i + lookahead]);
+            uint32_t row = slots[probe(countries[i], hash)];
+            if (row != empty)
+                res += populations[row];
+        }
+        return res;
+    }
+
+    // Number of countries.
+    size_t size() const
+    {
+        return populations.size();
+    }
+
+    // Name of the country stored at the given row.
+    std::string_view country(size_t row) const
+    {
+        return std::string_view(names.data() + offsets[row], offsets[row + 1] - offsets[row]);
+    }
+
+    // Population of the country stored at the given row.
+    int64_t population(size_t row) const
+    {
+        return populations[row];
+    }
+
+    // Sum of all the populations.
+    int64_t sum() const
+    {
+        int64_t res = 0;
+        for (int64_t population : populations)
+            res += population;
+        return res;
+    }
+
+    // Number of countries with a population in [low, high], and the sum of their populations.
+    std::pair<size_t, int64_t> sum_between(int64_t low, int64_t high) const
+    {
+        // Selecting with a mask rather than a branch keeps the loop vectorizable.
+        size_t count = 0;
+        int64_t res = 0;
+        for (int64_t population : populations)
+        {
+            int64_t in = population >= low && population <= high;
+            count += in;
+            res += population & -in;
+        }
+        return {count, res};
+    }
+
+    /**
+     * @brief Returns the rows of the countries with a population in [low, high], in row order.
+     */
+    std::vector<size_t> rows_between(int64_t low, int64_t high) const
+    {
+        std::vector<size_t> rows(populations.size());
+        size_t found = 0;
+        // Every row is written and only kept by advancing past it, so there is no branch to mispredict.
+        for (size_t row = 0; row < populations.size(); row++)
+        {
+            rows[found] = row;
+            found += populations[row] >= low && populations[row] <= high;
+        }
+        rows.resize(found);
+        return rows;
+    }
+
+    /**
+     * @brief Returns the rows of the `k` most populated countries, most populated first.
+     */
+    std::vector<size_t> top(size_t k) const
+    {
+        std::vector<size_t> rows(populations.size());
+        for (size_t row = 0; row < rows.size(); row++)
+            rows[row] = row;
+        k = std::min(k, rows.size());
+        auto larger = [&](size_t a, size_t b)
+        { return populations[a] != populations[b] ? populations[a] > populations[b] : a < b; };
+        std::nth_element(rows.begin(), rows.begin() + k, rows.end(), larger);
+        rows.resize(k);
+        std::sort(rows.begin(), rows.end(), larger);
+        return rows;
+    }
+
+private:
+    static constexpr uint32_t empty = UINT32_MAX;
+
+    // Names of all the countries back to back.
+    std::string names;
+    // Start of every name in `names`, followed by the end of the last one.
+    std::vector<size_t> offsets;
+    // Population of every row.
+    std::vector<int64_t> populations;
+    // Hash of every row's name, so that probing rarely compares strings.
+    std::vector<uint32_t> hashes;
+    // Open-addressing index from name to row; the size is always a power of two.
+    std::vector<uint32_t> slots;
+
+    static uint32_t hash_of(std::string_view country)
+    {
+        size_t hash = std::hash<std::string_view>{}(country);
+        return static_cast<uint32_t>(hash ^ (hash >> 32));
+    }
+
+    // Linear probing until either the country or an empty slot is found.
+    size_t probe(std::string_view name, uint32_t hash) const
+    {
+        size_t mask = slots.size() - 1;
+        size_t slot = hash & mask;
+        while (slots[slot] != empty && (hashes[slots[slot]] != hash || country(slots[slot]) != name))
+            slot = (slot + 1) & mask;
+        return slot;
+    }
+
+    // Hashes the country and starts loading its first index slot into the cache.
+    uint32_t prefetch(std::string_view name) const
+    {
+        uint32_t hash = hash_of(name);
+#if defined(__GNUC__)
+        __builtin_prefetch(&slots[hash & (slots.size() - 1)]);
+#endif
+        return hash;
+    }
+
+    void reserve(size_t rows)
+    {
+        offsets.reserve(rows + 1);
+        populations.reserve(rows);
+        hashes.reserve(rows);
+        if (rows * 2 > slots.size())
+            rehash(rows * 2);
+    }
+
+    void insert(std::string_view name, int64_t population)
+    {
+        uint32_t hash = hash_of(name);
+        size_t slot = probe(name, hash);
+        if (slots[slot] != empty)
+        {
+            populations[slots[slot]] = population;
+            return;
+        }
+
+        slots[slot] = static_cast<uint32_t>(populations.size());
+        names.append(name);
+        offsets.push_back(names.size());
+        populations.push_back(population);
+        hashes.push_back(hash);
+
+        // Keeps the load factor under 1/2 so that the probe sequences stay short.
+        if (populations.size() * 2 > slots.size())
+            rehash(slots.size());
+    }
+
+    // Rebuilds the index with more than `rows` slots.
+    void rehash(size_t rows)
+    {
+        size_t capacity = 16;
+        while (capacity <= rows)
+            capacity *= 2;
+        slots.assign(capacity, empty);
+        for (uint32_t row = 0; row < populations.size(); row++)
+        {
+            size_t slot = hashes[row] & (capacity - 1);
+            while (slots[slot] != empty)
+                slot = (slot + 1) & (capacity - 1);
+            slots[slot] = row;
+        }
+    }
+};
+
+/**
+ * @brief Collects the rows of a snapshot, the snapshot cannot be changed once it is built.
+ */
+class PopulationSnapshot::Builder
+{
+    PopulationSnapshot snapshot;
+
+public:
+    explicit Builder(size_t expected_rows = 0)
+    {
+        snapshot.reserve(expected_rows);
+    }
+
+    // Adds a row, a country that is already present takes the new population.
+    void add(std::string_view country, int64_t population)
+    {
+        snapshot.insert(country, population);
+    }
+
+    PopulationSnapshot build() &&
+    {
+        return std::move(snapshot);
+    }
+};
@@ -0,0 +1,156 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Holds the current version of an immutable object, which a writer can replace while readers keep using the old one (read-copy-update).
+ * A reader announces the epoch it entered in through a slot of its own, which takes a couple of atomic stores and never waits.
+ * A thread claims its slot on its first read of the cell, which may allocate and retry on the shared list of slots, so only the reads after that are wait-free.
+ * The writer frees the old version once every slot has left the epochs in which that version could have been read.
+ * !@warning No thread may read from the cell while it is being destroyed.
+ */
+template <typename T>
+class RcuCell
+{
+    struct Slot
+    {
+        // Epoch the owner entered its read in, 0 while it is not reading.
+        std::atomic<uint64_t> epoch{0};
+        // Whether a live thread owns the slot, slots of finished threads are reused.
+        std::atomic<bool> claimed{true};
+        // The cell and the thread using the slot, the last of them to let go deletes it.
+        std::atomic<int> owners{2};
+        Slot *next{nullptr};
+
+        static void release(Slot *slot)
+        {
+            if (slot->owners.fetch_sub(1) == 1)
+                delete slot;
+        }
+    };
+
+    // Tells cells apart in the per-thread claims, even when a new cell reuses the address of a destroyed one.
+    static inline std::atomic<uint64_t> next_id{0};
+    const uint64_t id{next_id++};
+
+    std::atomic<const T *> current;
+    std::atomic<uint64_t> global_epoch{1};
+    // Slots of all the threads that have read so far, only ever pushed to.
+    mutable std::atomic<Slot *> slots{nullptr};
+    // Serializes writers, readers never take it.
+    std::mutex writer;
+
+    // Returns the slot of the calling thread, claiming a free one or adding a new one on its first read.
+    // Every thread keeps the slots it claimed in a list, which is pruned of destroyed cells whenever a slot is claimed so that it only grows with the live cells read.
+    Slot &thread_slot() const
+    {
+        struct Claims
+        {
+            std::vector<std::pair<uint64_t, Slot *>> list;
+            ~Claims()
+            {
+                for (auto &claim : list)
+                {
+                    claim.second->claimed.store(false, std::memory_order_release);
+                    Slot::release(claim.second);
+                }
+            }
+        };
+        thread_local Claims claims;
+        for (auto &claim : claims.list)
+            if (claim.first == id)
+                return *claim.second;
+
+        // A slot left with a single owner is only held by this thread, its cell has been destroyed.
+        auto destroyed = std::remove_if(claims.list.begin(), claims.list.end(), [](const std::pair<uint64_t, Slot *> &claim)
+                                        {
+            if (claim.second->owners.load() != 1)
+                return false;
+            Slot::release(claim.second);
+            return true; });
+        claims.list.erase(destroyed, claims.list.end());
+
+        Slot *slot = slots.load();
+        for (; slot; slot = slot->next)
+        {
+            bool free = false;
+            if (slot->claimed.compare_exchange_strong(free, true))
+            {
+                slot->owners++;
+                break;
+            }
+        }
+        if (slot == nullptr)
+        {
+            slot = new Slot();
+            slot->next = slots.load();
+            while (!slots.compare_exchange_weak(slot->next, slot))
+                ;
+        }
+        claims.list.push_back({id, slot});
+        return *slot;
+    }
+
+public:
+    explicit RcuCell(std::unique_ptr<const T> initial) : current(initial.release()) {}
+
+    RcuCell(const RcuCell &) = delete;
+    RcuCell &operator=(const RcuCell &) = delete;
+
+    ~RcuCell()
+    {
+        delete current.load();
+        for (Slot *slot = slots.load(); slot;)
+            Slot::release(std::exchange(slot, slot->next));
+    }
+
+    /**
+     * @brief Calls `f` with the current version, which stays alive until `f` returns.
+     * Wait-free once the calling thread has read the cell before, the first read claims the slot of the thread.
+     */
+    template <typename F>
+    decltype(auto) read(F &&f) const
+    {
+        Slot &slot = thread_slot();
+        // Nested reads are covered by the outermost one.
+        bool outermost = slot.epoch.load(std::memory_order_relaxed) == 0;
+        if (outermost)
+            slot.epoch.store(global_epoch.load());
+
+        struct Leave
+        {
+            Slot &slot;
+            bool outermost;
+            ~Leave()
+            {
+                if (outermost)
+                    slot.epoch.store(0, std::memory_order_release);
+            }
+        } leave{slot, outermost};
+        return f(*current.load());
+    }
+
+    /**
+     * @brief Publishes a new version, then waits for the readers that may still see the old one before freeing it.
+     * !@warning Deadlocks if called from inside a `read` of the same cell, as it then waits for the read of its own thread to end.
+     */
+    void update(std::unique_ptr<const T> next)
+    {
+        std::lock_guard<std::mutex> lock(writer);
+        std::unique_ptr<const T> old(current.exchange(next.release()));
+        // Readers that enter from now on see the new version, only the ones that entered before can hold the old one.
+        uint64_t retired = global_epoch.fetch_add(1);
+        for (Slot *slot = slots.load(); slot; slot = slot->next)
+        {
+            uint64_t epoch;
+            while ((epoch = slot->epoch.load()) != 0 && epoch <= retired)
+                std::this_thread::yield();
+        }
+    }
+};
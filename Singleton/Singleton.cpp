@@ -6,43 +6,151 @@
  * What happens when we need data from the database to actually test the Singleton Database Class?
  */
 
+#include "AbstractDatabase.h"
+#include "PopulationLoader.h"
+#include "PopulationSnapshot.h"
+#include "RcuCell.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <exception>
 #include <fstream>
+#include <future>
 #include <gtest/gtest.h>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
 #include <vector>
 
 /**
- * @brief Interface for Database classes.
+ * @brief Times and sizes of the loads of the Database, to tell how much of the startup they take.
  */
-class AbstractDatabase
+struct LoadMetrics
 {
-public:
-    virtual int get_population(const std::string &country) = 0;
+    // From the start of the first load to the Database being ready.
+    std::chrono::nanoseconds startup{0};
+    // Total time callers of `get` spent blocked on the first load.
+    std::chrono::nanoseconds blocked{0};
+    // Duration and rows of the last load, be it the first one or a reload.
+    std::chrono::nanoseconds last_load{0};
+    size_t rows = 0;
+    size_t loads = 0;
+    // Whether the first load was started in the background by `warm_up`.
+    bool warmed_up = false;
 };
 
 /**
  * @brief Database class that loads up database and provides API to interact with it.
+ * Loading happens on the first `get`, or ahead of it on a background thread if `warm_up` is called at process start.
  */
 class Database : public AbstractDatabase
 {
+    // Current snapshot of the table, immutable once loaded so reads need no locking, and replaced as a whole on reload.
+    RcuCell<PopulationSnapshot> populations;
+
+    // Progress of the one-time construction of the instance.
+    struct Startup
+    {
+        std::mutex mutex;
+        std::condition_variable done;
+        bool started = false;
+        std::chrono::steady_clock::time_point start;
+        std::unique_ptr<Database> db;
+        std::exception_ptr error;
+        LoadMetrics metrics;
+        // Set once the instance is ready, so that `get` does not lock afterwards.
+        std::atomic<Database *> instance{nullptr};
+        // Joins the background load at exit, declared last so it is destroyed first.
+        std::future<void> background;
+    };
 
-    std::map<std::string, int> populations;
+    static Startup &startup()
+    {
+        static Startup state;
+        return state;
+    }
 
     /**
      * @brief Contructor is private so that no instantiation is done on the client-side.
      */
-    Database()
+    explicit Database(const std::string &path) : populations(load(path)) {}
+
+    static std::unique_ptr<const PopulationSnapshot> load(const std::string &path)
     {
         std::cout << "Loading Database ...\n";
-        std::ifstream ifs("db.csv");
-        std::string line;
-        while (std::getline(ifs, line))
+        auto start = std::chrono::steady_clock::now();
+        auto snapshot = std::make_unique<const PopulationSnapshot>(load_populations(path));
+
+        Startup &state = startup();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.metrics.last_load = std::chrono::steady_clock::now() - start;
+        state.metrics.rows = snapshot->size();
+        state.metrics.loads++;
+        return snapshot;
+    }
+
+    // Starts loading the instance, on a background thread or the calling one. Expects the startup lock to be held.
+    static void start(std::unique_lock<std::mutex> &lock, const std::string &path, bool background)
+    {
+        Startup &state = startup();
+        state.started = true;
+        state.start = std::chrono::steady_clock::now();
+        state.metrics.warmed_up = background;
+        if (background)
+        {
+            state.background = std::async(std::launch::async, [path]
+                                          { construct(path); });
+            return;
+        }
+        lock.unlock();
+        construct(path);
+        lock.lock();
+    }
+
+    static void construct(const std::string &path)
+    {
+        Startup &state = startup();
+        std::unique_ptr<Database> db;
+        std::exception_ptr error;
+        try
+        {
+            db.reset(new Database(path));
+        }
+        catch (...)
         {
-            std::string country = line.substr(0, line.find_first_of(','));
-            std::string population = line.substr(line.find_first_of(',') + 1, line.size());
-            populations[country] = std::stoi(population);
+            error = std::current_exception();
         }
+
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.db = std::move(db);
+        state.error = error;
+        state.metrics.startup = std::chrono::steady_clock::now() - state.start;
+        state.instance.store(state.db.get(), std::memory_order_release);
+        state.done.notify_all();
+    }
+
+    // Copies the given rows out of the snapshot, which may be replaced once the read is over.
+    static std::vector<std::pair<std::string, int64_t>> rows_of(const PopulationSnapshot &snapshot, const std::vector<size_t> &rows)
+    {
+        std::vector<std::pair<std::string, int64_t>> res;
+        res.reserve(rows.size());
+        for (size_t row : rows)
+            res.emplace_back(snapshot.country(row), snapshot.population(row));
+        return res;
+    }
+
+    // Returns the instance if it has been loaded, rethrowing the error the load ended with if any. Expects the startup lock to be held.
+    static Database *loaded()
+    {
+        Startup &state = startup();
+        if (state.error)
+            std::rethrow_exception(state.error);
+        return state.db.get();
     }
 
 public:
@@ -50,17 +158,109 @@ public:
     Database(Database &) = delete;
     void operator=(Database &) = delete;
 
-    // Returns a static database reference.
+    /**
+     * @brief Starts loading the database on a background thread so that the loading overlaps the rest of the initialization.
+     * Opt-in and meant to be called at process start, does nothing if loading has already started.
+     */
+    static void warm_up(const std::string &path = "db.csv")
+    {
+        std::unique_lock<std::mutex> lock(startup().mutex);
+        if (!startup().started)
+            start(lock, path, true);
+    }
+
+    // Returns a static database reference, loading it on the calling thread or waiting for the warm-up to finish if needed.
     static Database &get()
     {
-        static Database db;
-        return db;
+        Startup &state = startup();
+        if (Database *db = state.instance.load(std::memory_order_acquire))
+            return *db;
+
+        std::unique_lock<std::mutex> lock(state.mutex);
+        if (!state.started)
+            start(lock, "db.csv", false);
+        auto blocked_since = std::chrono::steady_clock::now();
+        state.done.wait(lock, []
+                        { return startup().db || startup().error; });
+        state.metrics.blocked += std::chrono::steady_clock::now() - blocked_since;
+        return *loaded();
     }
 
-    // Returns Population (in miliions) for a counrty.
-    int get_population(const std::string &country)
+    /**
+     * @brief Returns the database if it is ready within `timeout`, or nullptr if it is still loading.
+     * Never loads on the calling thread, so it starts the warm-up if nothing has started loading yet.
+     */
+    static Database *try_get(std::chrono::milliseconds timeout = std::chrono::milliseconds(0))
     {
-        return populations[country];
+        Startup &state = startup();
+        if (Database *db = state.instance.load(std::memory_order_acquire))
+            return db;
+
+        std::unique_lock<std::mutex> lock(state.mutex);
+        if (!state.started)
+            start(lock, "db.csv", true);
+        state.done.wait_for(lock, timeout, []
+                            { return startup().db || startup().error; });
+        return loaded();
+    }
+
+    // Returns the load metrics gathered so far.
+    static LoadMetrics load_metrics()
+    {
+        std::lock_guard<std::mutex> lock(startup().mutex);
+        return startup().metrics;
+    }
+
+    // Returns Population (in miliions) for a counrty, or 0 for an unknown country.
+    int64_t get_population(const std::string &country)
+    {
+        return populations.read([&](const PopulationSnapshot &snapshot)
+                                { return snapshot.get(country); });
+    }
+
+    // Sums the populations of all the countries against a single snapshot, prefetching the index ahead of the lookups.
+    int64_t total_population(const std::string *countries, size_t count)
+    {
+        return populations.read([&](const PopulationSnapshot &snapshot)
+                                { return snapshot.total(countries, count); });
+    }
+
+    // Sum of the populations of all the countries.
+    int64_t world_population()
+    {
+        return populations.read([](const PopulationSnapshot &snapshot)
+                                { return snapshot.sum(); });
+    }
+
+    // The `k` most populated countries with their populations, most populated first.
+    std::vector<std::pair<std::string, int64_t>> most_populated(size_t k)
+    {
+        return populations.read([&](const PopulationSnapshot &snapshot)
+                                { return rows_of(snapshot, snapshot.top(k)); });
+    }
+
+    // Countries with a population in [low, high] with their populations, in the order of the file.
+    std::vector<std::pair<std::string, int64_t>> countries_between(int64_t low, int64_t high)
+    {
+        return populations.read([&](const PopulationSnapshot &snapshot)
+                                { return rows_of(snapshot, snapshot.rows_between(low, high)); });
+    }
+
+    /**
+     * @brief Loads the file again and swaps the new snapshot in, readers keep using the old one until they are done with it.
+     */
+    void reload(const std::string &path = "db.csv")
+    {
+        populations.update(load(path));
+    }
+
+    /**
+     * @brief Same as `reload` but on a background thread, the returned future is ready once the new snapshot is in use.
+     */
+    std::future<void> reload_async(const std::string &path = "db.csv")
+    {
+        return std::async(std::launch::async, [this, path]
+                          { reload(path); });
     }
 };
 
@@ -71,14 +271,9 @@ public:
 class RecordFinder
 {
 public:
-    int total_population(std::vector<std::string> countries)
+    int64_t total_population(const std::vector<std::string> &countries)
     {
-        int res = 0;
-        for (auto country : countries)
-        {
-            res += Database::get().get_population(country);
-        }
-        return res;
+        return Database::get().total_population(countries.data(), countries.size());
     }
 };
 
@@ -96,13 +291,29 @@ TEST(TotalPopulationTests, RecordFinderTest)
     EXPECT_EQ(rf.total_population(countries), 1438 + 1380);
 }
 
+/**
+ * Once loaded, the Database is returned without waiting and its metrics account for the load.
+ */
+TEST(DatabaseTests, ReadyAfterLoad)
+{
+    Database &db = Database::get();
+    EXPECT_EQ(Database::try_get(), &db);
+
+    LoadMetrics metrics = Database::load_metrics();
+    EXPECT_GE(metrics.loads, 1u);
+    EXPECT_GT(metrics.rows, 0u);
+    // main() reloads before the tests run, so the last load need not be the one startup waited for.
+    EXPECT_GT(metrics.startup.count(), 0);
+    EXPECT_GT(metrics.last_load.count(), 0);
+}
+
 /**
  * @brief Dummy Database that allows the unit testing of RecordFinder class.
  * Acts a dependency injection to decouple RecordFinder and Database class.
  */
 class DummyDatabase : public AbstractDatabase
 {
-    std::map<std::string, int> dummy;
+    std::map<std::string, int64_t> dummy;
 
 public:
     DummyDatabase()
@@ -111,7 +322,7 @@ public:
         dummy["dummy2"] = 4;
         dummy["dummy3"] = 3;
     }
-    int get_population(const std::string &key)
+    int64_t get_population(const std::string &key)
     {
         return dummy[key];
     }
@@ -128,14 +339,9 @@ class BetterRecordFinder
 public:
     explicit BetterRecordFinder(AbstractDatabase &db): db{db} {}
 
-    int total_population(std::vector<std::string> countries)
+    int64_t total_population(const std::vector<std::string> &countries)
     {
-        int res = 0;
-        for (auto country : countries)
-        {
-            res += db.get_population(country);
-        }
-        return res;
+        return db.total_population(countries.data(), countries.size());
     }
 };
 
@@ -152,13 +358,201 @@ TEST(TotalPopulationTests, BetterRecordFinderTest)
     EXPECT_EQ(rf.total_population(keys), 5);
 }
 
+/**
+ * Looking up a country that is not in the database must not add it.
+ */
+TEST(PopulationSnapshotTests, MissingCountryIsNotInserted)
+{
+    PopulationSnapshot::Builder builder;
+    builder.add("India", 1380);
+    builder.add("India", 1400);
+    PopulationSnapshot snapshot = std::move(builder).build();
+
+    EXPECT_EQ(snapshot.get("India"), 1400);
+    EXPECT_EQ(snapshot.get("Atlantis"), 0);
+    EXPECT_FALSE(snapshot.find("Atlantis").has_value());
+    EXPECT_EQ(snapshot.size(), 1u);
+}
+
+/**
+ * The batched lookup gives the same sum as looking the countries up one at a time, over more keys than it prefetches ahead.
+ */
+TEST(PopulationSnapshotTests, BatchedTotalMatchesSingleLookups)
+{
+    PopulationSnapshot::Builder builder;
+    for (int i = 0; i < 100; i++)
+        builder.add("Country " + std::to_string(i), i);
+    PopulationSnapshot snapshot = std::move(builder).build();
+
+    std::vector<std::string> countries;
+    int64_t expected = 0;
+    for (int i = 0; i < 150; i += 3)
+    {
+        countries.push_back("Country " + std::to_string(i));
+        expected += snapshot.get(countries.back());
+    }
+    EXPECT_EQ(snapshot.total(countries.data(), countries.size()), expected);
+    EXPECT_EQ(snapshot.total(countries.data(), 2), 0 + 3);
+    EXPECT_EQ(snapshot.total(nullptr, 0), 0);
+}
+
+/**
+ * Aggregates run over the whole population column, and sums do not overflow past the range of an int.
+ */
+TEST(PopulationSnapshotTests, ColumnAggregates)
+{
+    PopulationSnapshot::Builder builder;
+    builder.add("India", 1380);
+    builder.add("China", 1438);
+    builder.add("Tuvalu", 0);
+    builder.add("Earth", 8000000000);
+    builder.add("Iceland", 1);
+    PopulationSnapshot snapshot = std::move(builder).build();
+
+    EXPECT_EQ(snapshot.sum(), 8000000000 + 1380 + 1438 + 1);
+    EXPECT_EQ(snapshot.sum_between(1, 1438), std::make_pair(size_t(3), int64_t(1380 + 1438 + 1)));
+    EXPECT_EQ(snapshot.rows_between(1, 1400), (std::vector<size_t>{0, 4}));
+    EXPECT_EQ(snapshot.top(2), (std::vector<size_t>{3, 1}));
+    EXPECT_EQ(snapshot.top(10).size(), 5u);
+    EXPECT_TRUE(snapshot.rows_between(2, 1).empty());
+}
+
+// Writes the contents to a file as is and loads it, the file is removed afterwards.
+static PopulationSnapshot load_contents(const std::string &contents)
+{
+    {
+        std::ofstream ofs("loader_test.csv", std::ios::binary);
+        ofs << contents;
+    }
+    struct Remove
+    {
+        ~Remove() { std::remove("loader_test.csv"); }
+    } remove;
+    return load_populations("loader_test.csv");
+}
+
+/**
+ * Blank lines, CRLF line endings, spaces before the population and a missing final newline are all accepted.
+ */
+TEST(PopulationSnapshotTests, LoaderAcceptsLooseFormatting)
+{
+    PopulationSnapshot snapshot = load_contents("India,1380\r\n\r\nChina, 1438\n\nTuvalu,\t0\r\nEarth,8000000000");
+    EXPECT_EQ(snapshot.size(), 4u);
+    EXPECT_EQ(snapshot.get("India"), 1380);
+    EXPECT_EQ(snapshot.get("China"), 1438);
+    EXPECT_TRUE(snapshot.find("Tuvalu").has_value());
+    EXPECT_EQ(snapshot.get("Earth"), 8000000000);
+    EXPECT_EQ(load_contents("").size(), 0u);
+}
+
+/**
+ * Malformed rows are reported along with the line they are on.
+ */
+TEST(PopulationSnapshotTests, LoaderRejectsMalformedRows)
+{
+    auto error = [](const std::string &contents) -> std::string
+    {
+        try
+        {
+            load_contents(contents);
+        }
+        catch (const std::runtime_error &e)
+        {
+            return e.what();
+        }
+        return "";
+    };
+    EXPECT_EQ(error("India,1380\nChina\n"), "loader_test.csv:2 has no population.");
+    EXPECT_EQ(error("India,1380\r\n\r\nChina,\r\n"), "loader_test.csv:3 has an invalid population.");
+    EXPECT_EQ(error("India,13a80\n"), "loader_test.csv:1 has an invalid population.");
+    EXPECT_EQ(error("India,1380 \n"), "loader_test.csv:1 has an invalid population.");
+    EXPECT_EQ(error("India,1380\nChina,99999999999999999999\n"), "loader_test.csv:2 has an invalid population.");
+}
+
+/**
+ * Readers running while versions are swapped only ever see whole versions, and every replaced version is freed.
+ */
+TEST(RcuCellTests, ReadersSurviveUpdates)
+{
+    static std::atomic<int> alive{0};
+    struct Version
+    {
+        int value;
+        explicit Version(int value) : value(value) { alive++; }
+        ~Version() { alive--; }
+    };
+
+    {
+        RcuCell<Version> cell(std::make_unique<const Version>(0));
+        std::atomic<bool> done{false};
+        std::vector<std::thread> readers;
+        for (int i = 0; i < 4; i++)
+            readers.emplace_back([&]
+                                 {
+                int last = 0;
+                while (!done)
+                {
+                    int value = cell.read([](const Version &v) { return v.value; });
+                    EXPECT_GE(value, last);
+                    last = value;
+                } });
+
+        for (int i = 1; i <= 1000; i++)
+            cell.update(std::make_unique<const Version>(i));
+        done = true;
+        for (auto &reader : readers)
+            reader.join();
+
+        EXPECT_EQ(cell.read([](const Version &v) { return v.value; }), 1000);
+        EXPECT_EQ(alive, 1);
+    }
+    EXPECT_EQ(alive, 0);
+}
+
+/**
+ * Threads reading from many cells in turn, each destroyed before the next is made, keep working as the slots of the destroyed cells are let go.
+ */
+TEST(RcuCellTests, ShortLivedCells)
+{
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 2; t++)
+        readers.emplace_back([]
+                             {
+            for (int i = 0; i < 1000; i++)
+            {
+                RcuCell<int> cell(std::make_unique<const int>(i));
+                EXPECT_EQ(cell.read([](int value) { return value; }), i);
+                cell.update(std::make_unique<const int>(i + 1));
+                EXPECT_EQ(cell.read([](int value) { return value; }), i + 1);
+            } });
+    for (auto &reader : readers)
+        reader.join();
+}
+
 int main(int argc, char *argv[])
 {
+    // Loading starts right away and overlaps whatever else the program initializes.
+    Database::warm_up();
+    if (!Database::try_get(std::chrono::milliseconds(1)))
+        std::cout << "Database not ready yet\n";
+
     // Getting the reference of the singleton object.
     auto db = &(Database::get());
+    LoadMetrics metrics = Database::load_metrics();
+    std::cout << "Loaded " << metrics.rows << " countries in " << std::chrono::duration<double, std::milli>(metrics.last_load).count() << " ms, "
+              << std::chrono::duration<double, std::milli>(metrics.blocked).count() << " ms blocked in get\n";
 
     std::string country = "India";
     std::cout << "Population of " << country << " is " << db->get_population(country) << " million\n";
+    std::cout << "World population is " << db->world_population() << " million, the most populated countries are";
+    for (auto &[name, population] : db->most_populated(3))
+        std::cout << " " << name << " (" << population << ")";
+    std::cout << "\n";
+
+    // The table can be refreshed without a restart, lookups keep working while it loads.
+    auto reloaded = db->reload_async();
+    std::cout << "Population of " << country << " is " << db->get_population(country) << " million\n";
+    reloaded.wait();
 
     testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();